@@ -0,0 +1,275 @@
+/*
+ * bench/matrix.cpp: Throughput benchmarks for lain::Matrix.
+ *
+ * Author: Lain Supe (lainproliant)
+ */
+#include "lain/argparse.h"
+#include "lain/benchmark.h"
+#include "lain/matrix.h"
+
+#include <fstream>
+
+using namespace std;
+using namespace lain;
+using namespace lain::bench;
+
+const int BIG_MATRIX_WIDTH = 40000;
+const int BIG_MATRIX_HEIGHT = 1000;
+
+struct Size {
+   int width, height;
+};
+
+class MatrixBenchmarks {
+public:
+   MatrixBenchmarks(const Options& opts, const string& filter) :
+      opts(opts), filter(filter) { }
+
+   template<class T, class Layout>
+   void run(const string& type_name, const string& layout_name, const Size& size) {
+      const int w = size.width, h = size.height;
+      const size_t n = (size_t)w * h;
+      const string suffix = tfm::format("/%s/%s/%dx%d", type_name, layout_name, w, h);
+
+      Matrix<T, Layout> m(w, h, T(1));
+      const Matrix<T, Layout>& cm = m;
+
+      add("construct" + suffix, n, n * sizeof(T), [&]() {
+         Matrix<T, Layout> fresh(w, h, T(1));
+         do_not_optimize(fresh.at(w - 1, h - 1));
+      });
+
+      add("clear" + suffix, n, n * sizeof(T), [&]() {
+         m.clear(T(1));
+         clobber_memory();
+      });
+
+      add("scan" + suffix, n, n * sizeof(T), [&]() {
+         T sum = T();
+         cm.scan([&](int, int, const T& val) {
+            sum += val;
+            return true;
+         });
+         do_not_optimize(sum);
+      });
+
+      add("rows" + suffix, n, n * sizeof(T), [&]() {
+         T sum = T();
+         for (int y = 0; y < h; y++) {
+            for (const T& val : cm.row(y)) {
+               sum += val;
+            }
+         }
+         do_not_optimize(sum);
+      });
+
+      add("columns" + suffix, n, n * sizeof(T), [&]() {
+         T sum = T();
+         for (int x = 0; x < w; x++) {
+            for (const T& val : cm.column(x)) {
+               sum += val;
+            }
+         }
+         do_not_optimize(sum);
+      });
+
+      add("copy" + suffix, n, 2 * n * sizeof(T), [&]() {
+         Matrix<T, Layout> copy(cm);
+         do_not_optimize(copy.at(w - 1, h - 1));
+      });
+
+      // Grows by half in each direction, copying the original cells
+      // and filling the new ones.
+      const size_t grown = (size_t)(w + w / 2) * (h + h / 2);
+      add("resized (copy)" + suffix, n, (n + grown) * sizeof(T), [&]() {
+         Matrix<T, Layout> bigger = cm.resized(w + w / 2, h + h / 2);
+         do_not_optimize(bigger.at(0, 0));
+      });
+
+      // Grows by half in each direction in place, within capacity
+      // reserved up front.  Shrinking back only changes the
+      // dimensions, so this times filling the newly exposed cells.
+      Matrix<T, Layout> growing(cm);
+      growing.reserve(w + w / 2, h + h / 2);
+      add("resize" + suffix, grown - n, (grown - n) * sizeof(T), [&]() {
+         growing.resize(w, h);
+         growing.resize(w + w / 2, h + h / 2);
+         do_not_optimize(growing.at(w + w / 2 - 1, h + h / 2 - 1));
+      });
+   }
+
+   template<class T>
+   void run_layouts(const string& type_name, const Size& size) {
+      run<T, RowMajor>(type_name, "row-major", size);
+      run<T, Tiled<>>(type_name, "tiled", size);
+   }
+
+   const vector<BenchmarkResult>& get_results() const {
+      return results;
+   }
+
+private:
+   template<class F>
+   void add(const string& name, size_t elements, size_t bytes, F f) {
+      if (name.find(filter) == string::npos) {
+         return;
+      }
+
+      Options bench_opts = opts;
+      bench_opts.elements = elements;
+      bench_opts.bytes = bytes;
+      results.push_back(measure(name, f, bench_opts));
+      cerr << "." << flush;
+   }
+
+   Options opts;
+   string filter;
+   vector<BenchmarkResult> results;
+};
+
+void print_usage(const string& program_name) {
+   cerr << "usage: " << program_name
+        << " [-r/--reps N] [-w/--warmup N] [-f/--filter TEXT] [-j/--json FILE] [-b/--big] [-c/--counters]"
+        << " [-B/--baseline FILE] [-s/--max-slowdown FRACTION]"
+        << endl;
+}
+
+/**
+ * Print the speedup of each tiled benchmark over the same benchmark
+ * with the row-major layout, e.g. for column sweeps, which the tiled
+ * layout exists to speed up.
+ */
+void print_layout_speedups(ostream& out, const vector<BenchmarkResult>& results) {
+   const string row_major = "/row-major/", tiled = "/tiled/";
+   map<string, double> row_major_medians;
+
+   for (const BenchmarkResult& result : results) {
+      string name = result.get_name();
+      size_t pos = name.find(row_major);
+      if (pos != string::npos) {
+         row_major_medians[name.replace(pos, row_major.size(), "/")] = result.median();
+      }
+   }
+
+   for (const BenchmarkResult& result : results) {
+      string name = result.get_name();
+      size_t pos = name.find(tiled);
+      if (pos == string::npos) {
+         continue;
+      }
+
+      auto iter = row_major_medians.find(name.replace(pos, tiled.size(), "/"));
+      if (iter != row_major_medians.end()) {
+         out << tfm::format("%-44s %8.2fx\n", name, iter->second / result.median());
+      }
+   }
+}
+
+/**
+ * Compare results against a baseline written by --json, printing
+ * and returning the number of regressions.
+ */
+int compare_to_baseline(const string& filename, const RegressionPolicy& policy,
+                        const vector<BenchmarkResult>& results) {
+   map<string, BenchmarkResult> baseline = load_results(filename);
+   int regressions = 0;
+
+   for (const BenchmarkResult& result : results) {
+      auto iter = baseline.find(result.get_name());
+      if (iter == baseline.end()) {
+         continue;
+      }
+
+      Comparison cmp = compare(iter->second, result, policy);
+      if (cmp.regressed) {
+         cout << "REGRESSION: " << result.get_name() << ": " << cmp.describe() << endl;
+         regressions++;
+      }
+   }
+
+   return regressions;
+}
+
+int main(int argc, char** argv) {
+   ArgumentBuilder builder;
+   builder
+      .arg('r', "reps").option()
+      .arg('w', "warmup").option()
+      .arg('f', "filter").option()
+      .arg('j', "json").option()
+      .arg('b', "big")
+      .arg('c', "counters")
+      .arg('B', "baseline").option()
+      .arg('s', "max-slowdown").option()
+      .arg('h', "help");
+
+   try {
+      Arguments args = builder.parse(argc, argv);
+      if (args.check("help")) {
+         print_usage(argv[0]);
+         return 0;
+      }
+
+      Options opts;
+      if (args.check("reps")) {
+         opts.repetitions = stoi(args.option("reps"));
+      }
+      if (args.check("warmup")) {
+         opts.warmup = stoi(args.option("warmup"));
+      }
+      opts.perf_counters = args.check("counters");
+
+      RegressionPolicy policy;
+      if (args.check("max-slowdown")) {
+         policy.max_slowdown = stod(args.option("max-slowdown"));
+      }
+
+      vector<Size> sizes = {{256, 256}, {2048, 1024}};
+      if (args.check("big")) {
+         sizes.push_back({BIG_MATRIX_WIDTH, BIG_MATRIX_HEIGHT});
+      }
+
+      MatrixBenchmarks benchmarks(opts, args.check("filter") ? args.option("filter") : "");
+      for (const Size& size : sizes) {
+         benchmarks.run_layouts<char>("char", size);
+         benchmarks.run_layouts<int>("int", size);
+         benchmarks.run_layouts<double>("double", size);
+      }
+      cerr << endl;
+
+      print_results(cout, benchmarks.get_results());
+      cout << endl << "Tiled speedup over row-major:" << endl;
+      print_layout_speedups(cout, benchmarks.get_results());
+      if (opts.perf_counters) {
+         for (const BenchmarkResult& result : benchmarks.get_results()) {
+            cout << result.get_name() << endl << format_summary(result);
+         }
+      }
+
+      if (args.check("json")) {
+         ofstream outfile(args.option("json"));
+         write_json(outfile, "matrix", benchmarks.get_results());
+      }
+
+      if (args.check("baseline")) {
+         return compare_to_baseline(args.option("baseline"), policy, benchmarks.get_results());
+      }
+
+   } catch (const ArgumentException& e) {
+      cerr << e.what() << endl;
+      print_usage(argv[0]);
+      return 1;
+
+   } catch (const invalid_argument&) {
+      cerr << "Expected a number." << endl;
+      print_usage(argv[0]);
+      return 1;
+
+   } catch (const out_of_range&) {
+      cerr << "Number out of range." << endl;
+      print_usage(argv[0]);
+      return 1;
+   }
+
+   return 0;
+}
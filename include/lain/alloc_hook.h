@@ -0,0 +1,149 @@
+/*
+ * alloc_hook.h: Optional per-thread allocation counting through a
+ *    replacement global operator new and delete.
+ *
+ * Define LAIN_INSTALL_ALLOC_HOOK before including this header in
+ * exactly one translation unit of a program to install the hook.
+ * Elsewhere, including this header only declares the counters, and
+ * hook_installed() reports whether any translation unit installed it.
+ *
+ * Author: Lain Supe (lainproliant)
+ */
+#ifndef __LAIN_ALLOC_HOOK_H
+#define __LAIN_ALLOC_HOOK_H
+
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+
+namespace lain {
+   namespace alloc {
+      /**
+       * Counts of allocations made through the global operator new
+       * and deallocations made through the global operator delete.
+       */
+      struct AllocationCounts {
+         size_t allocations;
+         size_t deallocations;
+         size_t bytes;
+
+         AllocationCounts operator-(const AllocationCounts& rhs) const {
+            return {allocations - rhs.allocations,
+                    deallocations - rhs.deallocations,
+                    bytes - rhs.bytes};
+         }
+      };
+
+      /**
+       * The counts for the calling thread since it started.  These are
+       * only updated while the hook is installed.
+       */
+      inline AllocationCounts& thread_counts() {
+         static thread_local AllocationCounts counts = {0, 0, 0};
+         return counts;
+      }
+
+      inline bool& hook_flag() {
+         static bool installed = false;
+         return installed;
+      }
+
+      /**
+       * Whether some translation unit defined LAIN_INSTALL_ALLOC_HOOK.
+       */
+      inline bool hook_installed() {
+         return hook_flag();
+      }
+
+      inline void* counted_malloc(size_t size) {
+         if (size == 0) {
+            size = 1;
+         }
+
+         for (;;) {
+            void* ptr = malloc(size);
+            if (ptr != nullptr) {
+               AllocationCounts& counts = thread_counts();
+               counts.allocations++;
+               counts.bytes += size;
+               return ptr;
+            }
+
+            std::new_handler handler = std::get_new_handler();
+            if (handler == nullptr) {
+               return nullptr;
+            }
+            handler();
+         }
+      }
+
+      inline void counted_free(void* ptr) noexcept {
+         if (ptr != nullptr) {
+            thread_counts().deallocations++;
+            free(ptr);
+         }
+      }
+   }
+}
+
+#ifdef LAIN_INSTALL_ALLOC_HOOK
+
+namespace lain {
+   namespace alloc {
+      namespace {
+         struct HookInstaller {
+            HookInstaller() {
+               hook_flag() = true;
+            }
+         } hook_installer;
+      }
+   }
+}
+
+void* operator new(std::size_t size) {
+   void* ptr = lain::alloc::counted_malloc(size);
+   if (ptr == nullptr) {
+      throw std::bad_alloc();
+   }
+   return ptr;
+}
+
+void* operator new[](std::size_t size) {
+   return ::operator new(size);
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept {
+   return lain::alloc::counted_malloc(size);
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept {
+   return lain::alloc::counted_malloc(size);
+}
+
+void operator delete(void* ptr) noexcept {
+   lain::alloc::counted_free(ptr);
+}
+
+void operator delete[](void* ptr) noexcept {
+   lain::alloc::counted_free(ptr);
+}
+
+void operator delete(void* ptr, std::size_t) noexcept {
+   lain::alloc::counted_free(ptr);
+}
+
+void operator delete[](void* ptr, std::size_t) noexcept {
+   lain::alloc::counted_free(ptr);
+}
+
+void operator delete(void* ptr, const std::nothrow_t&) noexcept {
+   lain::alloc::counted_free(ptr);
+}
+
+void operator delete[](void* ptr, const std::nothrow_t&) noexcept {
+   lain::alloc::counted_free(ptr);
+}
+
+#endif
+
+#endif
@@ -0,0 +1,481 @@
+/*
+ * benchmark.h: Timing, statistics and reporting for microbenchmarks.
+ *
+ * Author: Lain Supe (lainproliant)
+ */
+#ifndef __LAIN_BENCHMARK_H
+#define __LAIN_BENCHMARK_H
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <numeric>
+#include <string>
+#include <vector>
+
+#include "lain/file.h"
+#include "lain/perf_counters.h"
+#include "lain/settings.h"
+#include "lain/timing.h"
+#include "tinyformat/tinyformat.h"
+
+namespace lain {
+   namespace bench {
+      using namespace std;
+
+      /**
+       * Options controlling how a benchmark is measured.
+       */
+      struct Options {
+         // Untimed runs before measurement begins.
+         int warmup = 1;
+         // The number of timed samples to collect.
+         int repetitions = 10;
+         // Iterations per sample, or 0 to calibrate automatically.
+         size_t iterations = 0;
+         // The shortest sample calibration will aim for, so that clock
+         // resolution and call overhead are negligible.
+         double min_sample_ns = 5e6;
+         // An upper bound on calibrated iterations per sample.
+         size_t max_iterations = 1000000000;
+         // Elements processed per iteration, for ns/element.
+         size_t elements = 0;
+         // Bytes processed per iteration, for GB/s.
+         size_t bytes = 0;
+         // Collect performance counters during the timed samples, if
+         // the platform allows it.  See PerfCounters.
+         bool perf_counters = false;
+      };
+
+      /**
+       * The samples collected for a single benchmark, each being the
+       * mean time of one iteration within a sample, in nanoseconds.
+       */
+      class BenchmarkResult {
+      public:
+         BenchmarkResult() { }
+         BenchmarkResult(const string& name, const Options& opts,
+                         const vector<double>& samples) :
+            name(name), iterations(opts.iterations), elements(opts.elements),
+            bytes(opts.bytes), samples(samples) {
+            sort(this->samples.begin(), this->samples.end());
+         }
+
+         const string& get_name() const {
+            return name;
+         }
+
+         size_t get_iterations() const {
+            return iterations;
+         }
+
+         size_t get_elements() const {
+            return elements;
+         }
+
+         size_t get_bytes() const {
+            return bytes;
+         }
+
+         /**
+          * The samples in ascending order.
+          */
+         const vector<double>& get_samples() const {
+            return samples;
+         }
+
+         double mean() const {
+            return samples.empty() ? 0 :
+               accumulate(samples.begin(), samples.end(), 0.0) / samples.size();
+         }
+
+         /**
+          * The p-th percentile (0-100) of the samples, interpolating
+          * linearly between the closest ranks.
+          */
+         double percentile(double p) const {
+            if (samples.empty()) {
+               return 0;
+            }
+
+            double rank = p / 100.0 * (samples.size() - 1);
+            size_t lo = (size_t)floor(rank), hi = (size_t)ceil(rank);
+            return samples[lo] + (samples[hi] - samples[lo]) * (rank - lo);
+         }
+
+         double median() const {
+            return percentile(50);
+         }
+
+         double stddev() const {
+            if (samples.size() < 2) {
+               return 0;
+            }
+
+            double m = mean(), sum_sq = 0;
+            for (double s : samples) {
+               sum_sq += (s - m) * (s - m);
+            }
+            return sqrt(sum_sq / (samples.size() - 1));
+         }
+
+         double ns_per_element() const {
+            return elements > 0 ? median() / elements : 0;
+         }
+
+         /**
+          * Throughput at the median time, in GB/s.
+          */
+         double gb_per_second() const {
+            return bytes > 0 && median() > 0 ? bytes / median() : 0;
+         }
+
+         /**
+          * Performance counter values per iteration, averaged over all
+          * samples.  Empty if counters were not requested or were not
+          * available.
+          */
+         const map<string, double>& get_counters() const {
+            return counters;
+         }
+
+         void set_counters(const map<string, double>& counters) {
+            this->counters = counters;
+         }
+
+         Settings to_settings() const {
+            Settings obj;
+            obj.set<string>("name", name);
+            obj.set<double>("iterations", iterations);
+            obj.set<double>("elements", elements);
+            obj.set<double>("bytes", bytes);
+            obj.set<double>("mean_ns", mean());
+            obj.set<double>("median_ns", median());
+            obj.set<double>("p90_ns", percentile(90));
+            obj.set<double>("p99_ns", percentile(99));
+            obj.set<double>("stddev_ns", stddev());
+            obj.set<double>("ns_per_element", ns_per_element());
+            obj.set<double>("gb_per_second", gb_per_second());
+            obj.set_array<double>("samples_ns", samples);
+
+            if (! counters.empty()) {
+               Settings counter_obj;
+               for (auto& kv : counters) {
+                  counter_obj.set<double>(kv.first, kv.second);
+               }
+               obj.set_object("counters", counter_obj);
+            }
+            return obj;
+         }
+
+         /**
+          * Read a result written by to_settings().  Only the raw
+          * samples are read, the statistics are recomputed.
+          */
+         static BenchmarkResult from_settings(const Settings& obj) {
+            Options opts;
+            opts.iterations = (size_t)obj.get<double>("iterations");
+            opts.elements = (size_t)obj.get<double>("elements");
+            opts.bytes = (size_t)obj.get<double>("bytes");
+            BenchmarkResult result(obj.get<string>("name"), opts,
+                                   obj.get_array<double>("samples_ns"));
+
+            Settings counter_obj = obj.get_object("counters");
+            for (const string& key : counter_obj.get_keys()) {
+               result.counters[key] = counter_obj.get<double>(key);
+            }
+            return result;
+         }
+
+      private:
+         string name;
+         size_t iterations = 0, elements = 0, bytes = 0;
+         vector<double> samples;
+         map<string, double> counters;
+      };
+
+      /**
+       * Call f the given number of times, returning the total elapsed
+       * time in nanoseconds.
+       */
+      template<class F>
+      double time_iterations(F& f, size_t iterations) {
+         typedef chrono::steady_clock clock;
+
+         auto start = clock::now();
+         for (size_t x = 0; x < iterations; x++) {
+            f();
+         }
+         return chrono::duration<double, nano>(clock::now() - start).count();
+      }
+
+      /**
+       * Find the number of iterations of f needed for a sample to take
+       * at least opts.min_sample_ns, growing the count geometrically.
+       */
+      template<class F>
+      size_t calibrate(F& f, const Options& opts) {
+         size_t iterations = 1;
+
+         for (;;) {
+            double elapsed = time_iterations(f, iterations);
+            if (elapsed >= opts.min_sample_ns || iterations >= opts.max_iterations) {
+               return iterations;
+            }
+
+            // Overshoot slightly so that we rarely need another round,
+            // but never grow by more than 10x at once in case the
+            // first few iterations were unusually fast.
+            double scale = elapsed > 0 ? 1.2 * opts.min_sample_ns / elapsed : 10.0;
+            iterations = max(iterations + 1, (size_t)(iterations * min(scale, 10.0)));
+            iterations = min(iterations, opts.max_iterations);
+         }
+      }
+
+      /**
+       * Run f for opts.warmup untimed iterations, then collect
+       * opts.repetitions samples of opts.iterations calls each.
+       * If opts.iterations is 0, it is calibrated first.
+       */
+      template<class F>
+      BenchmarkResult measure(const string& name, F f, const Options& opts = Options()) {
+         Options run_opts = opts;
+         vector<double> samples;
+         unique_ptr<PerfCounters> counters;
+
+         for (int x = 0; x < opts.warmup; x++) {
+            f();
+         }
+
+         if (run_opts.iterations == 0) {
+            run_opts.iterations = calibrate(f, opts);
+         }
+
+         if (opts.perf_counters) {
+            counters.reset(new PerfCounters());
+            counters->start();
+         }
+
+         for (int rep = 0; rep < opts.repetitions; rep++) {
+            samples.push_back(time_iterations(f, run_opts.iterations) / run_opts.iterations);
+         }
+
+         if (counters) {
+            counters->stop();
+         }
+
+         BenchmarkResult result(name, run_opts, samples);
+
+         if (counters) {
+            map<string, double> values = counters->read();
+            const double total = (double)run_opts.iterations * max(opts.repetitions, 1);
+            for (auto& kv : values) {
+               kv.second /= total;
+            }
+            result.set_counters(values);
+         }
+
+         return result;
+      }
+
+      /**
+       * Summarize a single result in a few indented lines.
+       */
+      inline string format_summary(const BenchmarkResult& result) {
+         string summary = tfm::format(
+            "    mean %s, median %s, p99 %s, stddev %s (%d samples x %d iterations)\n",
+            format_ns(result.mean()), format_ns(result.median()),
+            format_ns(result.percentile(99)), format_ns(result.stddev()),
+            result.get_samples().size(), result.get_iterations());
+
+         if (result.get_elements() > 0) {
+            summary += tfm::format("    %.3f ns/element\n", result.ns_per_element());
+         }
+         if (result.get_bytes() > 0) {
+            summary += tfm::format("    %.3f GB/s\n", result.gb_per_second());
+         }
+
+         const map<string, double>& counters = result.get_counters();
+         if (! counters.empty()) {
+            summary += "   ";
+            for (auto& kv : counters) {
+               summary += tfm::format(" %s %.1f,", kv.first, kv.second);
+            }
+            summary.back() = ' ';
+            summary += "per iteration";
+
+            auto cycles = counters.find("cycles"), instructions = counters.find("instructions");
+            if (cycles != counters.end() && instructions != counters.end() && cycles->second > 0) {
+               summary += tfm::format(", IPC %.2f", instructions->second / cycles->second);
+            }
+            summary += "\n";
+         }
+
+         return summary;
+      }
+
+      /**
+       * Print a human readable table of results.
+       */
+      inline void print_results(ostream& out, const vector<BenchmarkResult>& results) {
+         out << tfm::format("%-44s %12s %12s %12s %10s %10s %9s\n",
+                            "benchmark", "mean", "median", "p99", "stddev",
+                            "ns/elem", "GB/s");
+
+         for (const BenchmarkResult& result : results) {
+            out << tfm::format("%-44s %12s %12s %12s %10s %10.3f %9.2f\n",
+                               result.get_name(),
+                               format_ns(result.mean()),
+                               format_ns(result.median()),
+                               format_ns(result.percentile(99)),
+                               format_ns(result.stddev()),
+                               result.ns_per_element(),
+                               result.gb_per_second());
+         }
+      }
+
+      /**
+       * Write results as a JSON object with a "benchmarks" array.
+       */
+      inline void write_json(ostream& out, const string& suite,
+                             const vector<BenchmarkResult>& results) {
+         Settings root;
+         vector<Settings> benchmarks;
+
+         for (const BenchmarkResult& result : results) {
+            benchmarks.push_back(result.to_settings());
+         }
+
+         root.set<string>("suite", suite);
+         root.set_object_array("benchmarks", benchmarks);
+         root.print(out, true);
+      }
+
+      /**
+       * Write results to a JSON file, e.g. to be used as a baseline.
+       */
+      inline void save_results(const string& filename, const string& suite,
+                               const vector<BenchmarkResult>& results) {
+         ofstream outfile = file::open_w(filename);
+         write_json(outfile, suite, results);
+      }
+
+      /**
+       * Read results written by write_json() or save_results(),
+       * indexed by benchmark name.
+       */
+      inline map<string, BenchmarkResult> load_results(const string& filename) {
+         map<string, BenchmarkResult> results;
+
+         for (const Settings& obj : Settings::load_from_file(filename).get_object_array("benchmarks")) {
+            BenchmarkResult result = BenchmarkResult::from_settings(obj);
+            results[result.get_name()] = result;
+         }
+
+         return results;
+      }
+
+      /**
+       * The one-sided p-value of the Mann-Whitney U test for the
+       * hypothesis that values in b tend to be larger than those in a,
+       * using the normal approximation with tie and continuity
+       * corrections.
+       */
+      inline double mann_whitney_p(const vector<double>& a, const vector<double>& b) {
+         const double n1 = a.size(), n2 = b.size(), n = n1 + n2;
+         if (a.empty() || b.empty()) {
+            return 1.0;
+         }
+
+         vector<pair<double, int>> pooled;
+         for (double v : a) {
+            pooled.push_back({v, 0});
+         }
+         for (double v : b) {
+            pooled.push_back({v, 1});
+         }
+         sort(pooled.begin(), pooled.end());
+
+         // Assign average ranks to ties, accumulating the rank sum of b
+         // and the tie correction term.
+         double rank_sum_b = 0, ties = 0;
+         for (size_t x = 0; x < pooled.size();) {
+            size_t y = x;
+            while (y < pooled.size() && pooled[y].first == pooled[x].first) {
+               y++;
+            }
+
+            const double t = y - x, rank = (x + 1 + y) / 2.0;
+            for (size_t z = x; z < y; z++) {
+               if (pooled[z].second == 1) {
+                  rank_sum_b += rank;
+               }
+            }
+            ties += t * t * t - t;
+            x = y;
+         }
+
+         const double u = rank_sum_b - n2 * (n2 + 1) / 2;
+         const double mean_u = n1 * n2 / 2;
+         const double var_u = n1 * n2 / 12 * ((n + 1) - ties / (n * (n - 1)));
+         if (var_u <= 0) {
+            return 1.0;
+         }
+
+         const double z = (u - mean_u - 0.5) / sqrt(var_u);
+         return 0.5 * erfc(z / sqrt(2.0));
+      }
+
+      /**
+       * Thresholds for deciding whether a result has regressed
+       * relative to its baseline.
+       */
+      struct RegressionPolicy {
+         // The fractional slowdown of the median tolerated, e.g. 0.10
+         // allows the median to be up to 10% slower than the baseline.
+         double max_slowdown = 0.10;
+         // If true, a slowdown is only a regression if the Mann-Whitney
+         // test also finds the samples significantly slower.
+         bool require_significance = true;
+         // The significance level for the Mann-Whitney test.
+         double alpha = 0.01;
+      };
+
+      /**
+       * The comparison of a result against its baseline.
+       */
+      struct Comparison {
+         double baseline_median = 0;
+         double current_median = 0;
+         double slowdown = 0;
+         double p_value = 1;
+         bool regressed = false;
+
+         string describe() const {
+            return tfm::format("median %s vs baseline %s (%+.1f%%, p=%.4f)",
+                               format_ns(current_median), format_ns(baseline_median),
+                               slowdown * 100, p_value);
+         }
+      };
+
+      inline Comparison compare(const BenchmarkResult& baseline,
+                                const BenchmarkResult& current,
+                                const RegressionPolicy& policy = RegressionPolicy()) {
+         Comparison cmp;
+         cmp.baseline_median = baseline.median();
+         cmp.current_median = current.median();
+         cmp.slowdown = cmp.baseline_median > 0 ?
+            cmp.current_median / cmp.baseline_median - 1 : 0;
+         cmp.p_value = mann_whitney_p(baseline.get_samples(), current.get_samples());
+         cmp.regressed = cmp.slowdown > policy.max_slowdown &&
+            (! policy.require_significance || cmp.p_value < policy.alpha);
+         return cmp;
+      }
+   }
+}
+
+#endif
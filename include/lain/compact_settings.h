@@ -0,0 +1,448 @@
+/*
+ * compact_settings.h: The Settings interface on top of a compact,
+ *    arena allocated json::Document.
+ *
+ * CompactSettings loads and queries large settings files with far
+ * fewer allocations and a fraction of the memory of the picojson
+ * backed Settings, at the cost of slower mutation.  It supports the
+ * same bool, int, float, double and string values, arrays of them,
+ * and nested objects.
+ *
+ * Author: Lain Supe (lainproliant)
+ */
+#ifndef __LAIN_COMPACT_SETTINGS_H
+#define __LAIN_COMPACT_SETTINGS_H
+
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "lain/json_dom.h"
+#include "lain/settings.h"
+
+namespace lain {
+   using namespace std;
+
+   namespace compact_impl {
+      /**
+       * How each supported value type is read from and written to a
+       * json::Node.  Other types fail to compile.
+       */
+      template <class T>
+      struct ValueTraits {
+         static_assert(sizeof(T) == 0,
+                       "CompactSettings supports bool, int, float, double and string values.");
+      };
+
+      template <>
+      struct ValueTraits<bool> {
+         static bool is(const json::Document& doc, json::NodeId id) {
+            return doc.type(id) == json::Type::BOOLEAN;
+         }
+
+         static bool get(const json::Document& doc, json::NodeId id) {
+            return doc.node(id).boolean;
+         }
+
+         static void set(json::Document& doc, json::NodeId id, bool value) {
+            doc.set_bool(id, value);
+         }
+      };
+
+      template <class T>
+      struct NumberTraits {
+         static bool is(const json::Document& doc, json::NodeId id) {
+            return doc.type(id) == json::Type::NUMBER;
+         }
+
+         static T get(const json::Document& doc, json::NodeId id) {
+            return (T)doc.node(id).number;
+         }
+
+         static void set(json::Document& doc, json::NodeId id, T value) {
+            doc.set_number(id, value);
+         }
+      };
+
+      template <> struct ValueTraits<int> : public NumberTraits<int> { };
+      template <> struct ValueTraits<float> : public NumberTraits<float> { };
+      template <> struct ValueTraits<double> : public NumberTraits<double> { };
+
+      template <>
+      struct ValueTraits<string> {
+         static bool is(const json::Document& doc, json::NodeId id) {
+            return doc.type(id) == json::Type::STRING;
+         }
+
+         static string get(const json::Document& doc, json::NodeId id) {
+            return doc.get_string(id).str();
+         }
+
+         static void set(json::Document& doc, json::NodeId id, const string& value) {
+            doc.set_string(id, value.data(), value.size());
+         }
+      };
+   }
+
+   /**
+    * A settings object backed by a json::Document, with the same
+    * interface as Settings.
+    *
+    * Copies of a CompactSettings, and the child objects returned by
+    * get_object(), get_object_array() and at_path(), are constant time
+    * views which share one document.  Unlike Settings, there is no copy
+    * on write: changes made through any view are visible in all of
+    * them.
+    */
+   class CompactSettings {
+   public:
+      CompactSettings() : doc(make_shared<json::Document>()), id(0) {
+         doc->set_object(id);
+      }
+
+      CompactSettings(const shared_ptr<json::Document>& doc, json::NodeId id) :
+         doc(doc), id(id) { }
+
+      virtual ~CompactSettings() { }
+
+      /**
+       * Load settings from a JSON file, which stays memory mapped for
+       * the life of the settings so that strings can refer to it.
+       */
+      static CompactSettings load_from_file(const string& filename) {
+         return load([&]() { return json::Document::parse_file(filename); },
+                     tfm::format("Settings file '%s'", filename));
+      }
+
+      static CompactSettings load_from_string(const string& json) {
+         return load([&]() { return json::Document::parse(json); }, "Settings string");
+      }
+
+      void save_to_file(const string& filename, bool prettify = false) const {
+         ofstream outfile = file::open_w(filename);
+         print(outfile, prettify);
+      }
+
+      void print(ostream& outfile, bool prettify = false) const {
+         outfile << to_string(prettify);
+      }
+
+      string to_string(bool prettify = false) const {
+         return doc->serialize(id, prettify);
+      }
+
+      bool contains(const string& name) const {
+         return doc->find(id, name) != json::NO_NODE;
+      }
+
+      vector<string> get_keys() const {
+         return doc->get_keys(id);
+      }
+
+      template <class T>
+      T get(const string& name) const {
+         json::NodeId member = doc->find(id, name);
+         if (member == json::NO_NODE) {
+            throw SettingsException(tfm::format(
+               "Missing value for key '%s'.", name));
+         }
+
+         if (! compact_impl::ValueTraits<T>::is(*doc, member)) {
+            throw SettingsException(tfm::format(
+               "Unexpected value type for key '%s'.", name));
+         }
+
+         return compact_impl::ValueTraits<T>::get(*doc, member);
+      }
+
+      template <class T>
+      T get(const string& name, const T& default_value) {
+         T value;
+         if (try_get<T>(name, value)) {
+            return value;
+         }
+
+         set<T>(name, default_value);
+         return default_value;
+      }
+
+      template <class T>
+      T get_default(const string& name, const T& default_value) const {
+         T value;
+         if (try_get<T>(name, value)) {
+            return value;
+         }
+         return default_value;
+      }
+
+      /**
+       * Look up name without throwing, as for Settings::try_get().
+       */
+      template <class T>
+      bool try_get(const string& name, T& value) const {
+         json::NodeId member = doc->find(id, name);
+         if (member == json::NO_NODE || ! compact_impl::ValueTraits<T>::is(*doc, member)) {
+            return false;
+         }
+
+         value = compact_impl::ValueTraits<T>::get(*doc, member);
+         return true;
+      }
+
+      template <class T>
+      void set(const string& name, const T& value) {
+         compact_impl::ValueTraits<T>::set(*doc, doc->set_member(id, name), value);
+      }
+
+      void set(const string& name, const char* value) {
+         set<string>(name, value);
+      }
+
+      template <class T>
+      vector<T> get_array(const string& name) const {
+         json::NodeId member = doc->find(id, name);
+         if (member == json::NO_NODE) {
+            throw SettingsException(tfm::format(
+               "Missing array for key '%s'.", name));
+         }
+
+         if (doc->type(member) != json::Type::ARRAY) {
+            throw SettingsException(tfm::format("Key '%s' does not refer to an array.", name));
+         }
+
+         vector<T> vec;
+         if (! read_array(member, vec)) {
+            throw SettingsException(tfm::format(
+               "Unexpected heterogenous value type in array for key '%s'.", name));
+         }
+         return vec;
+      }
+
+      template <class T>
+      vector<T> get_array(const string& name, const vector<T>& default_vec) {
+         vector<T> vec;
+         if (try_get_array<T>(name, vec)) {
+            return vec;
+         }
+
+         set_array<T>(name, default_vec);
+         return default_vec;
+      }
+
+      /**
+       * Look up an array of T without throwing, as for try_get().
+       */
+      template <class T>
+      bool try_get_array(const string& name, vector<T>& vec) const {
+         json::NodeId member = doc->find(id, name);
+         if (member == json::NO_NODE || doc->type(member) != json::Type::ARRAY) {
+            return false;
+         }
+
+         vector<T> result;
+         if (! read_array(member, result)) {
+            return false;
+         }
+         vec.swap(result);
+         return true;
+      }
+
+      template <class T>
+      void set_array(const string& name, const vector<T>& vec) {
+         json::NodeId member = doc->set_member(id, name);
+         doc->set_array(member, vec.size());
+         for (size_t x = 0; x < vec.size(); x++) {
+            compact_impl::ValueTraits<T>::set(*doc, doc->element(member, x), vec[x]);
+         }
+      }
+
+      vector<CompactSettings> get_object_array(const string& name) const {
+         json::NodeId member = doc->find(id, name);
+         if (member == json::NO_NODE || doc->type(member) != json::Type::ARRAY) {
+            throw SettingsException(tfm::format("Key '%s' does not refer to an object array.", name));
+         }
+
+         vector<CompactSettings> obj_array;
+         obj_array.reserve(doc->size(member));
+         for (size_t x = 0; x < doc->size(member); x++) {
+            json::NodeId element = doc->element(member, x);
+            if (doc->type(element) != json::Type::OBJECT) {
+               throw SettingsException(tfm::format("Object array contains non-object: '%s'", name));
+            }
+            obj_array.push_back(CompactSettings(doc, element));
+         }
+
+         return obj_array;
+      }
+
+      void set_object_array(const string& name, const vector<CompactSettings>& obj_list) {
+         // Copy before taking the slot, in case it is within one of the objects.
+         json::Document snapshot;
+         snapshot.set_array(snapshot.root(), obj_list.size());
+         for (size_t x = 0; x < obj_list.size(); x++) {
+            snapshot.copy(snapshot.element(snapshot.root(), x), *obj_list[x].doc, obj_list[x].id);
+         }
+         doc->copy(doc->set_member(id, name), snapshot, snapshot.root());
+      }
+
+      CompactSettings get_object(const string& name, bool must_exist = false) const {
+         json::NodeId member = doc->find(id, name);
+         if (member == json::NO_NODE) {
+            if (must_exist) {
+               throw SettingsException(tfm::format("Missing object for key '%s'.", name));
+
+            } else {
+               return CompactSettings();
+            }
+         }
+
+         if (doc->type(member) != json::Type::OBJECT) {
+            throw SettingsException(tfm::format("Key '%s' does not refer to a object.", name));
+         }
+
+         return CompactSettings(doc, member);
+      }
+
+      void set_object(const string& name, const CompactSettings& object) {
+         // Copy before taking the slot, in case it is within object.
+         json::Document snapshot;
+         snapshot.copy(snapshot.root(), *object.doc, object.id);
+         doc->copy(doc->set_member(id, name), snapshot, snapshot.root());
+      }
+
+      /**
+       * Get a view of the object at the given path, as for
+       * Settings::at_path().
+       */
+      CompactSettings at_path(const SettingsPath& path) const {
+         json::NodeId node = resolve(path);
+         if (node == json::NO_NODE || doc->type(node) != json::Type::OBJECT) {
+            throw SettingsException(tfm::format("No object at path '%s'.", path));
+         }
+         return CompactSettings(doc, node);
+      }
+
+      CompactSettings at_path(const string& path) const {
+         return at_path(SettingsPath(path));
+      }
+
+      CompactSettings at_pointer(const string& pointer) const {
+         return at_path(SettingsPath::pointer(pointer));
+      }
+
+      bool contains(const SettingsPath& path) const {
+         return resolve(path) != json::NO_NODE;
+      }
+
+      template <class T>
+      T get(const SettingsPath& path) const {
+         json::NodeId node = resolve(path);
+         if (node == json::NO_NODE) {
+            throw SettingsException(tfm::format("Missing value for path '%s'.", path));
+         }
+
+         if (! compact_impl::ValueTraits<T>::is(*doc, node)) {
+            throw SettingsException(tfm::format("Unexpected value type for path '%s'.", path));
+         }
+
+         return compact_impl::ValueTraits<T>::get(*doc, node);
+      }
+
+      template <class T>
+      T get_default(const SettingsPath& path, const T& default_value) const {
+         T value;
+         if (try_get<T>(path, value)) {
+            return value;
+         }
+         return default_value;
+      }
+
+      template <class T>
+      bool try_get(const SettingsPath& path, T& value) const {
+         json::NodeId node = resolve(path);
+         if (node == json::NO_NODE || ! compact_impl::ValueTraits<T>::is(*doc, node)) {
+            return false;
+         }
+
+         value = compact_impl::ValueTraits<T>::get(*doc, node);
+         return true;
+      }
+
+      /**
+       * The document these settings are a view of.
+       */
+      const json::Document& get_document() const {
+         return *doc;
+      }
+
+      friend ostream& operator<<(ostream& out, const CompactSettings& settings) {
+         out << settings.to_string();
+         return out;
+      }
+
+   private:
+      template <class F>
+      static CompactSettings load(F parse, const string& source) {
+         shared_ptr<json::Document> doc;
+
+         try {
+            doc = parse();
+
+         } catch (const json::JsonException& e) {
+            throw SettingsException(tfm::format("%s is not valid JSON: %s",
+                                                source, e.get_message()));
+         }
+
+         if (doc->type(doc->root()) != json::Type::OBJECT) {
+            throw SettingsException(tfm::format("%s does not contain an object.", source));
+         }
+
+         return CompactSettings(doc, doc->root());
+      }
+
+      json::NodeId resolve(const SettingsPath& path) const {
+         json::NodeId node = id;
+
+         for (const SettingsPath::Step& step : path.get_steps()) {
+            json::Type type = doc->type(node);
+            if (type == json::Type::OBJECT && step.type != SettingsPath::StepType::INDEX) {
+               node = doc->find(node, step.key);
+               if (node == json::NO_NODE) {
+                  return node;
+               }
+
+            } else if (type == json::Type::ARRAY && step.type != SettingsPath::StepType::KEY) {
+               if (step.index >= doc->size(node)) {
+                  return json::NO_NODE;
+               }
+               node = doc->element(node, step.index);
+
+            } else {
+               return json::NO_NODE;
+            }
+         }
+
+         return node;
+      }
+
+      template <class T>
+      bool read_array(json::NodeId array, vector<T>& vec) const {
+         size_t size = doc->size(array);
+         vec.reserve(size);
+         for (size_t x = 0; x < size; x++) {
+            json::NodeId element = doc->element(array, x);
+            if (! compact_impl::ValueTraits<T>::is(*doc, element)) {
+               return false;
+            }
+            vec.push_back(compact_impl::ValueTraits<T>::get(*doc, element));
+         }
+         return true;
+      }
+
+      shared_ptr<json::Document> doc;
+      json::NodeId id;
+   };
+}
+
+#endif
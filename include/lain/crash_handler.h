@@ -0,0 +1,430 @@
+/*
+ * crash_handler.h: An async-signal-safe crash reporter for fatal
+ *    signals, with offline symbolization of its reports.
+ *
+ * Author: Lain Supe (lainproliant)
+ */
+#ifndef __LAIN_CRASH_HANDLER_H
+#define __LAIN_CRASH_HANDLER_H
+
+#include <execinfo.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <sstream>
+#include <string>
+
+namespace lain {
+   namespace crash {
+      using namespace std;
+
+      const int MAX_FRAMES = 128;
+      const size_t OUTPUT_BUFFER_SIZE = 4096;
+      const size_t MAPS_BUFFER_SIZE = 256 * 1024;
+      const size_t ALTSTACK_SIZE = 64 * 1024;
+      // How long a thread which faults while another is reporting
+      // waits for that thread to terminate the process.
+      const int REPORT_WAIT_MS = 5000;
+      const int FATAL_SIGNALS[] = {SIGSEGV, SIGBUS, SIGFPE, SIGILL, SIGABRT};
+
+      /**
+       * Everything the signal handler touches, preallocated so that
+       * the handler itself never allocates.  It is trivially
+       * constructible so that it is zero initialized without a guard.
+       */
+      struct State {
+         int fd;
+         volatile sig_atomic_t handling;
+         bool prepared;
+         void* frames[MAX_FRAMES];
+         char output[OUTPUT_BUFFER_SIZE];
+         size_t output_length;
+         char maps[MAPS_BUFFER_SIZE];
+      };
+
+      inline State& state() {
+         static State s;
+         return s;
+      }
+
+      namespace impl {
+         inline void flush(State& s) {
+            size_t written = 0;
+            while (written < s.output_length) {
+               ssize_t len = ::write(s.fd, s.output + written, s.output_length - written);
+               if (len <= 0) {
+                  break;
+               }
+               written += len;
+            }
+            s.output_length = 0;
+         }
+
+         inline void put(State& s, const char* str, size_t length) {
+            for (size_t x = 0; x < length; x++) {
+               if (s.output_length == OUTPUT_BUFFER_SIZE) {
+                  flush(s);
+               }
+               s.output[s.output_length++] = str[x];
+            }
+         }
+
+         inline void put(State& s, const char* str) {
+            put(s, str, strlen(str));
+         }
+
+         inline void put_dec(State& s, long value) {
+            char digits[24];
+            int n = 0;
+            unsigned long v = value < 0 ? -(unsigned long)value : value;
+            do {
+               digits[n++] = '0' + v % 10;
+               v /= 10;
+            } while (v > 0);
+            if (value < 0) {
+               put(s, "-");
+            }
+            while (n > 0) {
+               put(s, &digits[--n], 1);
+            }
+         }
+
+         inline void put_hex(State& s, uintptr_t value) {
+            char digits[2 + sizeof(uintptr_t) * 2];
+            int n = 0;
+            do {
+               digits[n++] = "0123456789abcdef"[value & 0xf];
+               value >>= 4;
+            } while (value > 0);
+            put(s, "0x");
+            while (n > 0) {
+               put(s, &digits[--n], 1);
+            }
+         }
+
+         inline const char* parse_hex(const char* ptr, const char* end, uintptr_t& value) {
+            value = 0;
+            for (; ptr < end; ptr++) {
+               char c = *ptr;
+               if (c >= '0' && c <= '9') {
+                  value = value * 16 + (c - '0');
+               } else if (c >= 'a' && c <= 'f') {
+                  value = value * 16 + (c - 'a' + 10);
+               } else {
+                  break;
+               }
+            }
+            return ptr;
+         }
+
+         inline const char* skip_field(const char* ptr, const char* end) {
+            while (ptr < end && *ptr != ' ' && *ptr != '\n') {
+               ptr++;
+            }
+            while (ptr < end && *ptr == ' ') {
+               ptr++;
+            }
+            return ptr;
+         }
+
+         /**
+          * Read /proc/self/maps into the state's buffer, returning the
+          * number of bytes read.  A map too large for the buffer is
+          * truncated, leaving some frames without a module.
+          */
+         inline size_t read_maps(State& s) {
+            int fd = ::open("/proc/self/maps", O_RDONLY);
+            if (fd < 0) {
+               return 0;
+            }
+
+            size_t length = 0;
+            while (length < MAPS_BUFFER_SIZE) {
+               ssize_t len = ::read(fd, s.maps + length, MAPS_BUFFER_SIZE - length);
+               if (len <= 0) {
+                  break;
+               }
+               length += len;
+            }
+            ::close(fd);
+            return length;
+         }
+
+         /**
+          * Find the executable mapping containing addr, writing its path
+          * and the address' offset into the mapped file.
+          */
+         inline void put_module(State& s, size_t maps_length, uintptr_t addr) {
+            const char* ptr = s.maps;
+            const char* end = s.maps + maps_length;
+
+            while (ptr < end) {
+               const char* line_end = (const char*)memchr(ptr, '\n', end - ptr);
+               if (line_end == nullptr) {
+                  line_end = end;
+               }
+
+               // start-end perms offset dev inode path
+               uintptr_t start, stop, offset;
+               const char* field = parse_hex(ptr, line_end, start);
+               field = parse_hex(field + 1, line_end, stop);
+               field = skip_field(field, line_end);
+               bool executable = line_end - field > 3 && field[2] == 'x';
+               field = skip_field(field, line_end);
+               parse_hex(field, line_end, offset);
+               field = skip_field(skip_field(skip_field(field, line_end), line_end), line_end);
+
+               if (executable && addr >= start && addr < stop && field < line_end) {
+                  put(s, " ");
+                  put(s, field, line_end - field);
+                  put(s, "+");
+                  put_hex(s, addr - start + offset);
+                  return;
+               }
+
+               ptr = line_end + 1;
+            }
+         }
+
+         inline const char* signal_name(int sig) {
+            switch (sig) {
+            case SIGSEGV: return "SIGSEGV";
+            case SIGBUS: return "SIGBUS";
+            case SIGFPE: return "SIGFPE";
+            case SIGILL: return "SIGILL";
+            case SIGABRT: return "SIGABRT";
+            case SIGTRAP: return "SIGTRAP";
+            case SIGSYS: return "SIGSYS";
+            case SIGTERM: return "SIGTERM";
+            case SIGINT: return "SIGINT";
+            case SIGQUIT: return "SIGQUIT";
+            default: return "unknown signal";
+            }
+         }
+      }
+
+      /**
+       * Write a crash report for the given signal to the configured
+       * file descriptor: the signal, the faulting address, and one
+       * line per stack frame of the form
+       *
+       *    #N 0xADDRESS /path/to/module+0xOFFSET
+       *
+       * which symbolize_report() can resolve later.  This is
+       * async-signal-safe once install() has been called.
+       */
+      inline void write_report(int sig, void* address) {
+         State& s = state();
+         const int num_frames = backtrace(s.frames, MAX_FRAMES);
+         const size_t maps_length = impl::read_maps(s);
+
+         s.output_length = 0;
+         impl::put(s, "\nFATAL: Caught signal ");
+         impl::put_dec(s, sig);
+         impl::put(s, " (");
+         impl::put(s, impl::signal_name(sig));
+         impl::put(s, "), fault address ");
+         impl::put_hex(s, (uintptr_t)address);
+         impl::put(s, "\nStack trace (raw frames):\n");
+
+         for (int x = 0; x < num_frames; x++) {
+            impl::put(s, "#");
+            impl::put_dec(s, x);
+            impl::put(s, " ");
+            impl::put_hex(s, (uintptr_t)s.frames[x]);
+            impl::put_module(s, maps_length, (uintptr_t)s.frames[x]);
+            impl::put(s, "\n");
+         }
+
+         impl::put(s, "End of stack trace.\n");
+         impl::flush(s);
+      }
+
+      inline void handle_signal(int sig, siginfo_t* info, void*) {
+         State& s = state();
+
+         // Only the first thread to fault writes a report.  Others
+         // wait for it to terminate the process, but not forever in
+         // case it can't.  A second fault in the reporting thread is
+         // fatal at once, since the fatal signals are blocked while
+         // the handler runs.
+         if (__sync_lock_test_and_set(&s.handling, 1) == 0) {
+            write_report(sig, info != nullptr ? info->si_addr : nullptr);
+
+         } else {
+            struct timespec delay = {0, 10 * 1000 * 1000};
+            for (int ms = 0; ms < REPORT_WAIT_MS; ms += 10) {
+               nanosleep(&delay, nullptr);
+            }
+         }
+
+         // Restore the default action and re-raise, so the process
+         // terminates (and dumps core) as it would have without us.
+         struct sigaction action;
+         memset(&action, 0, sizeof(action));
+         action.sa_handler = SIG_DFL;
+         sigemptyset(&action.sa_mask);
+         sigaction(sig, &action, nullptr);
+         raise(sig);
+      }
+
+      /**
+       * Give the calling thread an alternate signal stack, so that the
+       * handler can run after a stack overflow.  install() does this
+       * for the thread which calls it; other threads which may
+       * overflow their stacks must call this themselves.
+       */
+      inline void install_altstack() {
+         static thread_local char* altstack = nullptr;
+         if (altstack != nullptr) {
+            return;
+         }
+
+         altstack = new char[ALTSTACK_SIZE];
+         stack_t ss;
+         memset(&ss, 0, sizeof(ss));
+         ss.ss_sp = altstack;
+         ss.ss_size = ALTSTACK_SIZE;
+         sigaltstack(&ss, nullptr);
+      }
+
+      /**
+       * Install the crash handler for sig, writing reports to fd.  After
+       * writing its report, the handler restores the default action
+       * and re-raises the signal.
+       */
+      inline void install(int sig, int fd = STDERR_FILENO) {
+         State& s = state();
+         s.fd = fd;
+
+         if (! s.prepared) {
+            // The first call to backtrace() may load libgcc, which
+            // allocates, so make it here rather than in the handler.
+            backtrace(s.frames, MAX_FRAMES);
+            s.prepared = true;
+         }
+         install_altstack();
+
+         struct sigaction action;
+         memset(&action, 0, sizeof(action));
+         action.sa_sigaction = handle_signal;
+         action.sa_flags = SA_SIGINFO | SA_ONSTACK;
+         sigemptyset(&action.sa_mask);
+         for (int fatal : FATAL_SIGNALS) {
+            sigaddset(&action.sa_mask, fatal);
+         }
+         sigaction(sig, &action, nullptr);
+      }
+
+      /**
+       * Install the crash handler for SIGSEGV, SIGBUS, SIGFPE, SIGILL
+       * and SIGABRT.
+       */
+      inline void install_fatal(int fd = STDERR_FILENO) {
+         for (int sig : FATAL_SIGNALS) {
+            install(sig, fd);
+         }
+      }
+
+      namespace impl {
+         /**
+          * Run addr2line(1) for a single address, passing the module
+          * and offset as arguments rather than through a shell, and
+          * read back the function and source location it prints.
+          */
+         inline bool addr2line(const string& module, const string& offset,
+                               string& function, string& location) {
+            int fds[2];
+            if (pipe(fds) != 0) {
+               return false;
+            }
+
+            pid_t pid = fork();
+            if (pid < 0) {
+               close(fds[0]);
+               close(fds[1]);
+               return false;
+
+            } else if (pid == 0) {
+               int null_fd = open("/dev/null", O_WRONLY);
+               dup2(fds[1], STDOUT_FILENO);
+               if (null_fd >= 0) {
+                  dup2(null_fd, STDERR_FILENO);
+               }
+               close(fds[0]);
+               close(fds[1]);
+
+               const char* argv[] = {"addr2line", "-C", "-f", "-e", module.c_str(),
+                                     offset.c_str(), nullptr};
+               execvp(argv[0], const_cast<char* const*>(argv));
+               _exit(127);
+            }
+
+            close(fds[1]);
+            FILE* proc = fdopen(fds[0], "r");
+            bool found = false;
+            if (proc != nullptr) {
+               char function_buf[1024] = "", location_buf[1024] = "";
+               if (fgets(function_buf, sizeof(function_buf), proc) != nullptr &&
+                   fgets(location_buf, sizeof(location_buf), proc) != nullptr) {
+                  function_buf[strcspn(function_buf, "\n")] = '\0';
+                  location_buf[strcspn(location_buf, "\n")] = '\0';
+                  function = function_buf;
+                  location = location_buf;
+                  found = true;
+               }
+               fclose(proc);
+            } else {
+               close(fds[0]);
+            }
+
+            int status = 0;
+            while (waitpid(pid, &status, 0) < 0 && errno == EINTR) { }
+            return found;
+         }
+      }
+
+      /**
+       * Resolve the frames of a report written by write_report() to
+       * function names and source lines using addr2line(1).  This is
+       * meant to be run offline, or in a parent process, never in a
+       * signal handler.  Frames which can't be resolved, e.g. because
+       * addr2line is not installed, are left as they are.
+       */
+      inline string symbolize_report(const string& report) {
+         istringstream in(report);
+         ostringstream out;
+         string line;
+
+         while (getline(in, line)) {
+            out << line;
+
+            size_t space = line.rfind(' '), plus = line.rfind("+0x");
+            if (line.size() > 0 && line[0] == '#' && space != string::npos &&
+                plus != string::npos && plus > space) {
+               string module = line.substr(space + 1, plus - space - 1);
+               string offset = line.substr(plus + 1);
+
+               string function, location;
+               if (impl::addr2line(module, offset, function, location) && function != "??") {
+                  out << " in " << function << " at " << location;
+               }
+            }
+
+            out << endl;
+         }
+
+         return out.str();
+      }
+   }
+}
+
+#endif
@@ -3,6 +3,7 @@
 
 #ifdef LAIN_ENABLE_STACKTRACE
 #include <execinfo.h>
+#include <cstdlib>
 #endif
 
 #include <exception>
@@ -14,29 +15,65 @@
 #include "lain/string.h"
 #include "tinyformat/tinyformat.h"
 
+#ifndef LAIN_STACKTRACE_MAX_FRAMES
+#define LAIN_STACKTRACE_MAX_FRAMES 64
+#endif
+
 namespace lain {
    using namespace std;
 
-   inline vector<string> generate_stacktrace(int max_frames = 256) {
+   /**
+    * Capture up to max_frames raw return addresses of the calling
+    * thread's stack into frames, returning the number captured.
+    * Does nothing and returns 0 unless LAIN_ENABLE_STACKTRACE is
+    * defined.
+    */
+   inline int capture_frames(void** frames, int max_frames) {
 #ifdef LAIN_ENABLE_STACKTRACE
-      void* frames[max_frames];
-      char** formatted_frames;
-      size_t num_frames = backtrace(frames, max_frames);
+      return backtrace(frames, max_frames);
+#else
+      (void)frames;
+      (void)max_frames;
+      return 0;
+#endif
+   }
+
+   /**
+    * Symbolize raw frames captured by capture_frames().
+    */
+   inline vector<string> symbolize_frames(void* const* frames, int num_frames) {
       vector<string> btvec;
-      formatted_frames = backtrace_symbols(frames, num_frames);
-      for (size_t x = 0; x < num_frames; x++) {
+
+#ifdef LAIN_ENABLE_STACKTRACE
+      if (num_frames <= 0) {
+         return btvec;
+      }
+
+      char** formatted_frames = backtrace_symbols(frames, num_frames);
+      if (formatted_frames == nullptr) {
+         return btvec;
+      }
+
+      for (int x = 0; x < num_frames; x++) {
          string formatted_frame = string(formatted_frames[x]);
          if (formatted_frame.size() > 0) {
             btvec.push_back(formatted_frame);
          }
       }
+      free(formatted_frames);
 #else
-      vector<string> btvec(0);
+      (void)frames;
+      (void)num_frames;
 #endif
 
       return btvec;
    }
 
+   inline vector<string> generate_stacktrace(int max_frames = 256) {
+      vector<void*> frames(max_frames);
+      return symbolize_frames(frames.data(), capture_frames(frames.data(), max_frames));
+   }
+
    inline string format_stacktrace(const vector<string>& stacktrace) {
       return tfm::format("Stack Trace -->\n\t%s",
             str::join(stacktrace, "\n\t"));
@@ -44,16 +81,24 @@ namespace lain {
 
    /**
     * A generic base exception class.
+    *
+    * If LAIN_ENABLE_STACKTRACE is defined, the raw frames of the stack
+    * at construction are captured into the exception itself without
+    * allocating, and are only symbolized when get_stacktrace() or
+    * format_stacktrace() is first called.  Otherwise no stack is
+    * captured and constructing an exception allocates nothing beyond
+    * its message.
     */
    class Exception : public runtime_error {
    public:
-      Exception(const string& message) : runtime_error(message.c_str()) {
-         stacktrace = generate_stacktrace();
+      Exception(string message) :
+         runtime_error(""), message(move(message)) {
+#ifdef LAIN_ENABLE_STACKTRACE
+         num_frames = capture_frames(frames, LAIN_STACKTRACE_MAX_FRAMES);
+#endif
 #ifdef LAIN_STACKTRACE_IN_DESCRIPTION
          this->message = tfm::format("%s\n%s\n",
-            message, format_stacktrace());
-#else
-         this->message = message;
+            this->message, format_stacktrace());
 #endif
       }
 
@@ -68,6 +113,7 @@ namespace lain {
 
       string format_stacktrace() const {
          ostringstream sb;
+         const vector<string>& stacktrace = get_stacktrace();
 
          for (size_t x = 0; x < stacktrace.size(); x++) {
             sb << x << ": " << stacktrace[x] << endl;
@@ -80,13 +126,28 @@ namespace lain {
          out << format_stacktrace();
       }
 
+      /**
+       * The symbolized stack at construction, which is empty unless
+       * LAIN_ENABLE_STACKTRACE is defined.  Symbolization happens on
+       * the first call, so this must not be called concurrently on
+       * the same exception from multiple threads.
+       */
       const vector<string>& get_stacktrace() const {
+#ifdef LAIN_ENABLE_STACKTRACE
+         if (num_frames > 0 && stacktrace.empty()) {
+            stacktrace = symbolize_frames(frames, num_frames);
+         }
+#endif
          return stacktrace;
       }
 
    private:
       string message;
-      vector<string> stacktrace;
+      mutable vector<string> stacktrace;
+#ifdef LAIN_ENABLE_STACKTRACE
+      void* frames[LAIN_STACKTRACE_MAX_FRAMES];
+      int num_frames = 0;
+#endif
    };
 
    class ValueException : public Exception {
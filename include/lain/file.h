@@ -1,6 +1,11 @@
 #ifndef __LAIN_FILE_H
 #define __LAIN_FILE_H
 
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
 #include <string>
 #include <iostream>
 #include <fstream>
@@ -33,11 +38,11 @@ namespace lain {
       }
 
       inline ofstream open_w(const string& filename,
-                             ios::openmode = ios::out) {
+                             ios::openmode mode = ios::out) {
          try {
             ofstream outfile;
             outfile.exceptions(ios::failbit);
-            outfile.open(filename);
+            outfile.open(filename, mode);
             outfile.exceptions(ios::badbit);
             return outfile;
 
@@ -63,6 +68,95 @@ namespace lain {
                   filename, strerror(errno)));
          }
       }
+
+      /**
+       * A read-only memory mapping of an entire file, advised for
+       * sequential access.  An empty file maps to a null data() with
+       * a size() of zero.
+       */
+      class MappedFile {
+      public:
+         MappedFile(const string& filename) {
+            fd = ::open(filename.c_str(), O_RDONLY);
+            if (fd < 0) {
+               throw FileException(tfm::format("Cannot open file '%s' for reading: %s",
+                                               filename, strerror(errno)));
+            }
+
+            struct stat st;
+            if (fstat(fd, &st) != 0) {
+               int error = errno;
+               close();
+               throw FileException(tfm::format("Cannot stat file '%s': %s",
+                                               filename, strerror(error)));
+            }
+
+            length = st.st_size;
+            if (length == 0) {
+               return;
+            }
+
+            void* base = ::mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (base == MAP_FAILED) {
+               int error = errno;
+               close();
+               throw FileException(tfm::format("Cannot map file '%s': %s",
+                                               filename, strerror(error)));
+            }
+
+            madvise(base, length, MADV_SEQUENTIAL);
+            _data = static_cast<const char*>(base);
+         }
+
+         MappedFile(MappedFile&& rhs) {
+            *this = move(rhs);
+         }
+
+         MappedFile& operator=(MappedFile&& rhs) {
+            if (this != &rhs) {
+               close();
+               fd = rhs.fd;
+               _data = rhs._data;
+               length = rhs.length;
+               rhs.fd = -1;
+               rhs._data = nullptr;
+               rhs.length = 0;
+            }
+            return *this;
+         }
+
+         MappedFile(const MappedFile&) = delete;
+         MappedFile& operator=(const MappedFile&) = delete;
+
+         virtual ~MappedFile() {
+            close();
+         }
+
+         const char* data() const {
+            return _data;
+         }
+
+         size_t size() const {
+            return length;
+         }
+
+      private:
+         void close() {
+            if (_data != nullptr) {
+               munmap(const_cast<char*>(_data), length);
+               _data = nullptr;
+            }
+
+            if (fd >= 0) {
+               ::close(fd);
+               fd = -1;
+            }
+         }
+
+         int fd = -1;
+         const char* _data = nullptr;
+         size_t length = 0;
+      };
    }
 }
 
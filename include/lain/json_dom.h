@@ -0,0 +1,707 @@
+/*
+ * json_dom.h: A compact, arena allocated JSON document.
+ *
+ * A Document stores every value as a fixed size Node in one flat
+ * vector, addressed by index.  Object keys are interned once per
+ * document, objects are stored as ranges of (key, node) members
+ * sorted by key, and arrays as ranges of node indices.  Strings
+ * without escapes are referenced in place in the source buffer, which
+ * the document keeps alive; all other strings live in an arena.
+ *
+ * Author: Lain Supe (lainproliant)
+ */
+#ifndef __LAIN_JSON_DOM_H
+#define __LAIN_JSON_DOM_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "lain/json_stream.h"
+
+namespace lain {
+   namespace json {
+      using namespace std;
+
+      typedef uint32_t NodeId;
+      typedef uint32_t KeyId;
+
+      const NodeId NO_NODE = UINT32_MAX;
+
+      enum class Type : uint8_t {
+         NULL_VALUE,
+         BOOLEAN,
+         NUMBER,
+         STRING,
+         ARRAY,
+         OBJECT
+      };
+
+      /**
+       * A single value.  For strings, count is the length of str.  For
+       * arrays and objects, count is the number of elements or members
+       * starting at begin in the document's element or member vector.
+       */
+      struct Node {
+         Type type;
+         uint32_t count;
+         union {
+            bool boolean;
+            double number;
+            const char* str;
+            uint32_t begin;
+         };
+      };
+
+      struct Member {
+         KeyId key;
+         NodeId node;
+      };
+
+      /**
+       * A bump allocator for bytes, which are only freed when the
+       * arena is destroyed.
+       */
+      class Arena {
+      public:
+         Arena(size_t chunk_size = 16 * 1024) : chunk_size(chunk_size) { }
+
+         Arena(const Arena&) = delete;
+         Arena& operator=(const Arena&) = delete;
+
+         char* allocate(size_t size) {
+            if (size > chunk_size / 4) {
+               // Large allocations get a chunk of their own, so as not
+               // to waste the rest of the current chunk.
+               chunks.emplace(chunks.begin(), new char[size]);
+               total += size;
+               return chunks.front().get();
+            }
+
+            if (chunks.empty() || used + size > chunk_size) {
+               chunks.emplace_back(new char[chunk_size]);
+               total += chunk_size;
+               used = 0;
+            }
+
+            char* ptr = chunks.back().get() + used;
+            used += size;
+            return ptr;
+         }
+
+         const char* copy(const char* data, size_t size) {
+            char* ptr = allocate(size);
+            memcpy(ptr, data, size);
+            return ptr;
+         }
+
+         size_t bytes_reserved() const {
+            return total;
+         }
+
+      private:
+         size_t chunk_size;
+         vector<unique_ptr<char[]>> chunks;
+         size_t used = 0;
+         size_t total = 0;
+      };
+
+      /**
+       * Interns object keys, so that each distinct key is stored once
+       * and members can be compared by id.
+       */
+      class KeyTable {
+      public:
+         KeyId intern(const char* data, size_t size) {
+            scratch.assign(data, size);
+            auto iter = ids.find(scratch);
+            if (iter != ids.end()) {
+               return iter->second;
+            }
+
+            KeyId id = names.size();
+            iter = ids.emplace(scratch, id).first;
+            names.push_back(&iter->first);
+            return id;
+         }
+
+         KeyId intern(const string& name) {
+            return intern(name.data(), name.size());
+         }
+
+         /**
+          * Find the id of an interned key without interning it.
+          */
+         bool find(const string& name, KeyId& id) const {
+            auto iter = ids.find(name);
+            if (iter == ids.end()) {
+               return false;
+            }
+            id = iter->second;
+            return true;
+         }
+
+         const string& name(KeyId id) const {
+            return *names[id];
+         }
+
+         size_t size() const {
+            return names.size();
+         }
+
+      private:
+         unordered_map<string, KeyId> ids;
+         vector<const string*> names;
+         string scratch;
+      };
+
+      /**
+       * A compact JSON document.  Reading a document is thread safe.
+       * Mutation appends to the document: replacing a container or
+       * adding a member to an object leaves the old storage unused
+       * until the document is destroyed, so documents are best suited
+       * to being loaded once and read many times.
+       */
+      class Document {
+      public:
+         Document() {
+            nodes.push_back(make_node(Type::NULL_VALUE));
+         }
+
+         Document(const Document&) = delete;
+         Document& operator=(const Document&) = delete;
+
+         /**
+          * Parse a document from a string, which the document takes
+          * ownership of.  Throws JsonException if it isn't valid JSON.
+          */
+         static shared_ptr<Document> parse(string json) {
+            shared_ptr<Document> doc = make_shared<Document>();
+            doc->source = move(json);
+            doc->build(doc->source.data(), doc->source.size());
+            return doc;
+         }
+
+         /**
+          * Memory map and parse a document from a file, which stays
+          * mapped for the life of the document.
+          */
+         static shared_ptr<Document> parse_file(const string& filename) {
+            shared_ptr<Document> doc = make_shared<Document>();
+            doc->mapped.reset(new file::MappedFile(filename));
+            doc->build(doc->mapped->data(), doc->mapped->size());
+            return doc;
+         }
+
+         NodeId root() const {
+            return 0;
+         }
+
+         const Node& node(NodeId id) const {
+            return nodes[id];
+         }
+
+         Type type(NodeId id) const {
+            return nodes[id].type;
+         }
+
+         StringRef get_string(NodeId id) const {
+            return {nodes[id].str, nodes[id].count};
+         }
+
+         size_t size(NodeId id) const {
+            const Node& n = nodes[id];
+            return n.type == Type::ARRAY || n.type == Type::OBJECT ? n.count : 0;
+         }
+
+         /**
+          * The index-th element of an array.
+          */
+         NodeId element(NodeId array, size_t index) const {
+            return elements[nodes[array].begin + index];
+         }
+
+         /**
+          * The member of an object with the given name, or NO_NODE if
+          * there is none or id is not an object.
+          */
+         NodeId find(NodeId id, const string& name) const {
+            KeyId key;
+            if (nodes[id].type != Type::OBJECT || ! keys.find(name, key)) {
+               return NO_NODE;
+            }
+            return find(id, key);
+         }
+
+         NodeId find(NodeId id, KeyId key) const {
+            const Node& n = nodes[id];
+            if (n.type != Type::OBJECT) {
+               return NO_NODE;
+            }
+
+            auto first = members.begin() + n.begin;
+            auto last = first + n.count;
+            auto iter = lower_bound(first, last, key, [](const Member& m, KeyId k) {
+               return m.key < k;
+            });
+            return iter != last && iter->key == key ? iter->node : NO_NODE;
+         }
+
+         /**
+          * The names of an object's members, in sorted order.
+          */
+         vector<string> get_keys(NodeId id) const {
+            vector<string> names;
+            if (nodes[id].type == Type::OBJECT) {
+               const Node& n = nodes[id];
+               for (uint32_t x = 0; x < n.count; x++) {
+                  names.push_back(keys.name(members[n.begin + x].key));
+               }
+               sort(names.begin(), names.end());
+            }
+            return names;
+         }
+
+         const KeyTable& get_key_table() const {
+            return keys;
+         }
+
+         /**
+          * Create a new, unattached node.
+          */
+         NodeId add_node(Type type = Type::NULL_VALUE) {
+            nodes.push_back(make_node(type));
+            return nodes.size() - 1;
+         }
+
+         void set_null(NodeId id) {
+            nodes[id] = make_node(Type::NULL_VALUE);
+         }
+
+         void set_bool(NodeId id, bool value) {
+            nodes[id] = make_node(Type::BOOLEAN);
+            nodes[id].boolean = value;
+         }
+
+         void set_number(NodeId id, double value) {
+            nodes[id] = make_node(Type::NUMBER);
+            nodes[id].number = value;
+         }
+
+         void set_string(NodeId id, const char* data, size_t size) {
+            nodes[id] = make_node(Type::STRING);
+            nodes[id].str = strings.copy(data, size);
+            nodes[id].count = size;
+         }
+
+         void set_object(NodeId id) {
+            nodes[id] = make_node(Type::OBJECT);
+            nodes[id].begin = members.size();
+         }
+
+         /**
+          * Make id an array of size new null elements, to be filled in
+          * through element().
+          */
+         void set_array(NodeId id, size_t size) {
+            uint32_t begin = elements.size();
+            for (size_t x = 0; x < size; x++) {
+               elements.push_back(add_node());
+            }
+            nodes[id] = make_node(Type::ARRAY);
+            nodes[id].begin = begin;
+            nodes[id].count = size;
+         }
+
+         /**
+          * Get the member of object id with the given name, adding it
+          * as null if there is none.
+          */
+         NodeId set_member(NodeId id, const string& name) {
+            KeyId key = keys.intern(name);
+            NodeId existing = find(id, key);
+            if (existing != NO_NODE) {
+               return existing;
+            }
+
+            // Members of an object are contiguous, so move them to the
+            // end of the member vector with the new member in order.
+            NodeId member = add_node();
+            uint32_t begin = members.size(), count = nodes[id].count;
+            bool inserted = false;
+            for (uint32_t x = 0; x < count; x++) {
+               Member m = members[nodes[id].begin + x];
+               if (! inserted && key < m.key) {
+                  members.push_back({key, member});
+                  inserted = true;
+               }
+               members.push_back(m);
+            }
+            if (! inserted) {
+               members.push_back({key, member});
+            }
+
+            nodes[id].begin = begin;
+            nodes[id].count = count + 1;
+            return member;
+         }
+
+         /**
+          * Deep copy the node src of another document, which may be
+          * this one, into the node dst of this document.
+          */
+         void copy(NodeId dst, const Document& other, NodeId src) {
+            if (&other == this) {
+               // dst may be within src, so copy from a snapshot.
+               Document snapshot;
+               snapshot.copy(snapshot.root(), other, src);
+               copy(dst, snapshot, snapshot.root());
+               return;
+            }
+
+            const Node n = other.nodes[src];
+            switch (n.type) {
+            case Type::STRING:
+               set_string(dst, n.str, n.count);
+               break;
+
+            case Type::ARRAY:
+               set_array(dst, n.count);
+               for (uint32_t x = 0; x < n.count; x++) {
+                  copy(element(dst, x), other, other.element(src, x));
+               }
+               break;
+
+            case Type::OBJECT: {
+               set_object(dst);
+               vector<Member> copied;
+               for (uint32_t x = 0; x < n.count; x++) {
+                  const Member& m = other.members[n.begin + x];
+                  copied.push_back({keys.intern(other.keys.name(m.key)), add_node()});
+               }
+               sort(copied.begin(), copied.end(), [](const Member& a, const Member& b) {
+                  return a.key < b.key;
+               });
+               nodes[dst].begin = members.size();
+               nodes[dst].count = copied.size();
+               members.insert(members.end(), copied.begin(), copied.end());
+
+               for (uint32_t x = 0; x < n.count; x++) {
+                  const Member& m = other.members[n.begin + x];
+                  copy(find(dst, keys.intern(other.keys.name(m.key))), other, m.node);
+               }
+               break;
+            }
+
+            default:
+               nodes[dst] = n;
+            }
+         }
+
+         /**
+          * Serialize a node in the same format as picojson.
+          */
+         string serialize(NodeId id, bool prettify = false) const {
+            string out;
+            serialize(out, id, prettify ? 0 : -1);
+            if (prettify) {
+               out.push_back('\n');
+            }
+            return out;
+         }
+
+         /**
+          * The number of bytes reserved by the document's nodes,
+          * members, elements, interned keys and arena, excluding the
+          * source buffer.
+          */
+         size_t memory_usage() const {
+            size_t key_bytes = 0;
+            for (size_t x = 0; x < keys.size(); x++) {
+               key_bytes += sizeof(string) + sizeof(KeyId) + keys.name(x).capacity();
+            }
+
+            return nodes.capacity() * sizeof(Node) +
+               members.capacity() * sizeof(Member) +
+               elements.capacity() * sizeof(NodeId) +
+               key_bytes + strings.bytes_reserved();
+         }
+
+      private:
+         static Node make_node(Type type) {
+            Node n;
+            n.type = type;
+            n.count = 0;
+            n.number = 0;
+            return n;
+         }
+
+         /**
+          * Builds the document in a single pass.  The members or
+          * elements of each open container are collected on a shared
+          * pending stack, and are moved into place contiguously when
+          * the container closes.
+          */
+         class Builder : public Handler {
+         public:
+            Builder(Document& doc, const char* begin, const char* end) :
+               doc(doc), begin(begin), end(end) { }
+
+            Action start_object() override {
+               open(Type::OBJECT);
+               return Action::CONTINUE;
+            }
+
+            Action end_object() override {
+               Frame frame = frames.back();
+               frames.pop_back();
+
+               auto first = pending.begin() + frame.start;
+               sort_members(first, pending.end());
+
+               // Keep only the last of any duplicate keys, as picojson does.
+               Node& n = doc.nodes[frame.node];
+               n.begin = doc.members.size();
+               for (auto iter = first; iter != pending.end(); iter++) {
+                  if (iter + 1 != pending.end() && (iter + 1)->key == iter->key) {
+                     continue;
+                  }
+                  doc.members.push_back(*iter);
+               }
+               n.count = doc.members.size() - n.begin;
+               pending.resize(frame.start);
+               return Action::CONTINUE;
+            }
+
+            Action start_array() override {
+               open(Type::ARRAY);
+               return Action::CONTINUE;
+            }
+
+            Action end_array() override {
+               Frame frame = frames.back();
+               frames.pop_back();
+
+               Node& n = doc.nodes[frame.node];
+               n.begin = doc.elements.size();
+               n.count = pending.size() - frame.start;
+               for (size_t x = frame.start; x < pending.size(); x++) {
+                  doc.elements.push_back(pending[x].node);
+               }
+               pending.resize(frame.start);
+               return Action::CONTINUE;
+            }
+
+            Action key(const StringRef& name) override {
+               pending_key = doc.keys.intern(name.data, name.size);
+               return Action::CONTINUE;
+            }
+
+            Action null_value() override {
+               add(Type::NULL_VALUE);
+               return Action::CONTINUE;
+            }
+
+            Action bool_value(bool value) override {
+               doc.nodes[add(Type::BOOLEAN)].boolean = value;
+               return Action::CONTINUE;
+            }
+
+            Action number_value(double value) override {
+               doc.nodes[add(Type::NUMBER)].number = value;
+               return Action::CONTINUE;
+            }
+
+            Action string_value(const StringRef& value) override {
+               Node& n = doc.nodes[add(Type::STRING)];
+               n.count = value.size;
+               if (value.data >= begin && value.data + value.size <= end) {
+                  n.str = value.data;
+               } else {
+                  n.str = doc.strings.copy(value.data, value.size);
+               }
+               return Action::CONTINUE;
+            }
+
+         private:
+            struct Frame {
+               NodeId node;
+               size_t start;
+            };
+
+            /**
+             * Stable sort members by key.  Most objects are small, and
+             * an insertion sort avoids the temporary buffer which
+             * stable_sort() allocates for each one.
+             */
+            static void sort_members(vector<Member>::iterator first, vector<Member>::iterator last) {
+               if (last - first > 32) {
+                  stable_sort(first, last, [](const Member& a, const Member& b) {
+                     return a.key < b.key;
+                  });
+                  return;
+               }
+
+               for (auto iter = first + (first != last); iter < last; iter++) {
+                  Member m = *iter;
+                  auto hole = iter;
+                  for (; hole > first && (hole - 1)->key > m.key; hole--) {
+                     *hole = *(hole - 1);
+                  }
+                  *hole = m;
+               }
+            }
+
+            NodeId add(Type type) {
+               NodeId id;
+               if (frames.empty()) {
+                  id = doc.root();
+                  doc.nodes[id] = make_node(type);
+               } else {
+                  id = doc.add_node(type);
+                  pending.push_back({pending_key, id});
+               }
+               return id;
+            }
+
+            void open(Type type) {
+               NodeId id = add(type);
+               frames.push_back({id, pending.size()});
+            }
+
+            Document& doc;
+            const char* begin;
+            const char* end;
+            vector<Frame> frames;
+            vector<Member> pending;
+            KeyId pending_key = 0;
+         };
+
+         void build(const char* data, size_t size) {
+            Builder builder(*this, data, data + size);
+            json::parse(data, size, builder);
+         }
+
+         static void indent(string& out, int level) {
+            out.push_back('\n');
+            out.append(level * 2, ' ');
+         }
+
+         static void serialize_string(string& out, const char* data, size_t size) {
+            out.push_back('"');
+            for (size_t x = 0; x < size; x++) {
+               char c = data[x];
+               switch (c) {
+               case '"': out.append("\\\""); break;
+               case '\\': out.append("\\\\"); break;
+               case '/': out.append("\\/"); break;
+               case '\b': out.append("\\b"); break;
+               case '\f': out.append("\\f"); break;
+               case '\n': out.append("\\n"); break;
+               case '\r': out.append("\\r"); break;
+               case '\t': out.append("\\t"); break;
+               default:
+                  if ((unsigned char)c < 0x20 || c == 0x7f) {
+                     char buf[7];
+                     snprintf(buf, sizeof(buf), "\\u%04x", c & 0xff);
+                     out.append(buf);
+                  } else {
+                     out.push_back(c);
+                  }
+               }
+            }
+            out.push_back('"');
+         }
+
+         void serialize(string& out, NodeId id, int level) const {
+            const Node& n = nodes[id];
+            switch (n.type) {
+            case Type::NULL_VALUE:
+               out.append("null");
+               break;
+
+            case Type::BOOLEAN:
+               out.append(n.boolean ? "true" : "false");
+               break;
+
+            case Type::NUMBER: {
+               char buf[64];
+               double integral;
+               snprintf(buf, sizeof(buf),
+                        fabs(n.number) < (1ULL << 53) && modf(n.number, &integral) == 0 ? "%.f" : "%.17g",
+                        n.number);
+               out.append(buf);
+               break;
+            }
+
+            case Type::STRING:
+               serialize_string(out, n.str, n.count);
+               break;
+
+            case Type::ARRAY:
+               out.push_back('[');
+               for (uint32_t x = 0; x < n.count; x++) {
+                  if (x > 0) {
+                     out.push_back(',');
+                  }
+                  if (level >= 0) {
+                     indent(out, level + 1);
+                  }
+                  serialize(out, element(id, x), level >= 0 ? level + 1 : -1);
+               }
+               if (level >= 0 && n.count > 0) {
+                  indent(out, level);
+               }
+               out.push_back(']');
+               break;
+
+            case Type::OBJECT: {
+               // Members are sorted by key id; picojson writes them in
+               // name order.
+               vector<Member> sorted(members.begin() + n.begin, members.begin() + n.begin + n.count);
+               sort(sorted.begin(), sorted.end(), [&](const Member& a, const Member& b) {
+                  return keys.name(a.key) < keys.name(b.key);
+               });
+
+               out.push_back('{');
+               for (uint32_t x = 0; x < sorted.size(); x++) {
+                  if (x > 0) {
+                     out.push_back(',');
+                  }
+                  if (level >= 0) {
+                     indent(out, level + 1);
+                  }
+                  const string& name = keys.name(sorted[x].key);
+                  serialize_string(out, name.data(), name.size());
+                  out.push_back(':');
+                  if (level >= 0) {
+                     out.push_back(' ');
+                  }
+                  serialize(out, sorted[x].node, level >= 0 ? level + 1 : -1);
+               }
+               if (level >= 0 && n.count > 0) {
+                  indent(out, level);
+               }
+               out.push_back('}');
+               break;
+            }
+            }
+         }
+
+         vector<Node> nodes;
+         vector<Member> members;
+         vector<NodeId> elements;
+         KeyTable keys;
+         Arena strings;
+         string source;
+         unique_ptr<file::MappedFile> mapped;
+      };
+   }
+}
+
+#endif
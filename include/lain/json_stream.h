@@ -0,0 +1,609 @@
+/*
+ * json_stream.h: A single-pass, event based (SAX style) JSON parser
+ *    over an in-memory or memory-mapped buffer.
+ *
+ * The parser calls back into a Handler for each value it reads rather
+ * than building a document, so its memory use is bounded by the
+ * nesting depth and the longest escaped string in the input, not by
+ * the size of the input.  Handlers may skip subtrees they don't need,
+ * which are then scanned over without being decoded.
+ *
+ * Author: Lain Supe (lainproliant)
+ */
+#ifndef __LAIN_JSON_STREAM_H
+#define __LAIN_JSON_STREAM_H
+
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#include "lain/exception.h"
+#include "lain/file.h"
+
+namespace lain {
+   namespace json {
+      using namespace std;
+
+      const int DEFAULT_MAX_DEPTH = 512;
+
+      class JsonException : public Exception {
+      public:
+         using Exception::Exception;
+      };
+
+      /**
+       * What the parser should do after a Handler callback.
+       *
+       * CONTINUE: Carry on parsing.
+       * SKIP: From start_object() or start_array(), skip the contents
+       *    of the container and its end event.  From key(), skip the
+       *    key's value.  Elsewhere, the same as CONTINUE.
+       * STOP: Stop parsing at once, making parse() return false.
+       */
+      enum class Action {
+         CONTINUE,
+         SKIP,
+         STOP
+      };
+
+      /**
+       * A string in the input, which is only valid for the duration of
+       * the callback it is passed to.  Strings without escapes point
+       * directly into the input buffer.
+       */
+      struct StringRef {
+         const char* data;
+         size_t size;
+
+         string str() const {
+            return string(data, size);
+         }
+
+         bool operator==(const string& rhs) const {
+            return rhs.size() == size && memcmp(rhs.data(), data, size) == 0;
+         }
+
+         bool operator!=(const string& rhs) const {
+            return ! (*this == rhs);
+         }
+      };
+
+      inline bool operator==(const string& lhs, const StringRef& rhs) {
+         return rhs == lhs;
+      }
+
+      inline bool operator!=(const string& lhs, const StringRef& rhs) {
+         return rhs != lhs;
+      }
+
+      /**
+       * The callbacks invoked by Parser.  Every callback continues by
+       * default, so handlers only override the events they need.
+       */
+      class Handler {
+      public:
+         virtual ~Handler() { }
+
+         virtual Action start_object() {
+            return Action::CONTINUE;
+         }
+
+         virtual Action end_object() {
+            return Action::CONTINUE;
+         }
+
+         virtual Action start_array() {
+            return Action::CONTINUE;
+         }
+
+         virtual Action end_array() {
+            return Action::CONTINUE;
+         }
+
+         virtual Action key(const StringRef& name) {
+            (void)name;
+            return Action::CONTINUE;
+         }
+
+         virtual Action null_value() {
+            return Action::CONTINUE;
+         }
+
+         virtual Action bool_value(bool value) {
+            (void)value;
+            return Action::CONTINUE;
+         }
+
+         virtual Action number_value(double value) {
+            (void)value;
+            return Action::CONTINUE;
+         }
+
+         virtual Action string_value(const StringRef& value) {
+            (void)value;
+            return Action::CONTINUE;
+         }
+      };
+
+      /**
+       * Parses a single JSON value from a buffer, which need not be
+       * null terminated, calling back into a Handler as it goes.
+       * Skipped subtrees are only checked for balanced brackets and
+       * terminated strings.
+       */
+      class Parser {
+      public:
+         Parser(const char* data, size_t size, int max_depth = DEFAULT_MAX_DEPTH) :
+            begin(data), end(data + size), ptr(data), max_depth(max_depth) { }
+
+         /**
+          * Parse the buffer, returning false if the handler stopped
+          * parsing early.  Throws JsonException if the input is not
+          * well formed.
+          */
+         bool parse(Handler& handler) {
+            ptr = begin;
+            skip_whitespace();
+            if (! parse_value(handler, 0)) {
+               return false;
+            }
+
+            skip_whitespace();
+            if (ptr != end) {
+               error("Unexpected characters after the end of the document.");
+            }
+            return true;
+         }
+
+      private:
+         int peek() const {
+            return ptr < end ? (unsigned char)*ptr : -1;
+         }
+
+         void skip_whitespace() {
+            while (ptr < end && (*ptr == ' ' || *ptr == '\n' || *ptr == '\r' || *ptr == '\t')) {
+               ptr++;
+            }
+         }
+
+         void expect(char c, const char* message) {
+            skip_whitespace();
+            if (peek() != c) {
+               error(message);
+            }
+            ptr++;
+         }
+
+         bool parse_value(Handler& handler, int depth) {
+            switch (peek()) {
+            case '{':
+               return parse_object(handler, depth);
+
+            case '[':
+               return parse_array(handler, depth);
+
+            case '"':
+               return handler.string_value(parse_string()) != Action::STOP;
+
+            case 't':
+               parse_literal("true");
+               return handler.bool_value(true) != Action::STOP;
+
+            case 'f':
+               parse_literal("false");
+               return handler.bool_value(false) != Action::STOP;
+
+            case 'n':
+               parse_literal("null");
+               return handler.null_value() != Action::STOP;
+
+            case -1:
+               error("Unexpected end of input.");
+
+            default:
+               return handler.number_value(parse_number()) != Action::STOP;
+            }
+         }
+
+         bool parse_object(Handler& handler, int depth) {
+            if (depth >= max_depth) {
+               error("Maximum nesting depth exceeded.");
+            }
+
+            Action action = handler.start_object();
+            if (action == Action::STOP) {
+               return false;
+            } else if (action == Action::SKIP) {
+               skip_container();
+               return true;
+            }
+
+            ptr++;
+            skip_whitespace();
+            if (peek() == '}') {
+               ptr++;
+               return handler.end_object() != Action::STOP;
+            }
+
+            for (;;) {
+               skip_whitespace();
+               if (peek() != '"') {
+                  error("Expected a string key.");
+               }
+
+               StringRef name = parse_string();
+               expect(':', "Expected ':' after key.");
+               skip_whitespace();
+
+               action = handler.key(name);
+               if (action == Action::STOP) {
+                  return false;
+               } else if (action == Action::SKIP) {
+                  skip_value();
+               } else if (! parse_value(handler, depth + 1)) {
+                  return false;
+               }
+
+               skip_whitespace();
+               int c = peek();
+               ptr++;
+               if (c == '}') {
+                  break;
+               } else if (c != ',') {
+                  ptr--;
+                  error("Expected ',' or '}' in object.");
+               }
+            }
+
+            return handler.end_object() != Action::STOP;
+         }
+
+         bool parse_array(Handler& handler, int depth) {
+            if (depth >= max_depth) {
+               error("Maximum nesting depth exceeded.");
+            }
+
+            Action action = handler.start_array();
+            if (action == Action::STOP) {
+               return false;
+            } else if (action == Action::SKIP) {
+               skip_container();
+               return true;
+            }
+
+            ptr++;
+            skip_whitespace();
+            if (peek() == ']') {
+               ptr++;
+               return handler.end_array() != Action::STOP;
+            }
+
+            for (;;) {
+               skip_whitespace();
+               if (! parse_value(handler, depth + 1)) {
+                  return false;
+               }
+
+               skip_whitespace();
+               int c = peek();
+               ptr++;
+               if (c == ']') {
+                  break;
+               } else if (c != ',') {
+                  ptr--;
+                  error("Expected ',' or ']' in array.");
+               }
+            }
+
+            return handler.end_array() != Action::STOP;
+         }
+
+         void parse_literal(const char* literal) {
+            size_t length = strlen(literal);
+            if ((size_t)(end - ptr) < length || memcmp(ptr, literal, length) != 0) {
+               error("Unexpected character.");
+            }
+            ptr += length;
+         }
+
+         size_t scan_digits() {
+            const char* start = ptr;
+            while (ptr < end && *ptr >= '0' && *ptr <= '9') {
+               ptr++;
+            }
+            return ptr - start;
+         }
+
+         double parse_number() {
+            const char* start = ptr;
+            bool negative = peek() == '-';
+            if (negative) {
+               ptr++;
+            }
+
+            const char* digits = ptr;
+            size_t num_digits = scan_digits();
+            if (num_digits == 0) {
+               error("Unexpected character.");
+            }
+
+            bool integral = true;
+            if (peek() == '.') {
+               ptr++;
+               if (scan_digits() == 0) {
+                  error("Expected digits after the decimal point.");
+               }
+               integral = false;
+            }
+
+            if (peek() == 'e' || peek() == 'E') {
+               ptr++;
+               if (peek() == '+' || peek() == '-') {
+                  ptr++;
+               }
+               if (scan_digits() == 0) {
+                  error("Expected digits in the exponent.");
+               }
+               integral = false;
+            }
+
+            // Integers of up to 15 digits are exact in a double, so
+            // accumulate them directly rather than calling strtod().
+            if (integral && num_digits <= 15) {
+               double value = 0;
+               for (size_t x = 0; x < num_digits; x++) {
+                  value = value * 10 + (digits[x] - '0');
+               }
+               return negative ? -value : value;
+            }
+
+            // The buffer isn't null terminated, so strtod() needs a copy.
+            char buffer[64];
+            size_t length = ptr - start;
+            if (length < sizeof(buffer)) {
+               memcpy(buffer, start, length);
+               buffer[length] = '\0';
+               return strtod(buffer, nullptr);
+            }
+            return strtod(string(start, length).c_str(), nullptr);
+         }
+
+         unsigned int parse_hex4() {
+            if (end - ptr < 4) {
+               error("Unexpected end of input in unicode escape.");
+            }
+
+            unsigned int value = 0;
+            for (int x = 0; x < 4; x++) {
+               char c = *ptr++;
+               value <<= 4;
+               if (c >= '0' && c <= '9') {
+                  value |= c - '0';
+               } else if (c >= 'a' && c <= 'f') {
+                  value |= c - 'a' + 10;
+               } else if (c >= 'A' && c <= 'F') {
+                  value |= c - 'A' + 10;
+               } else {
+                  ptr--;
+                  error("Invalid unicode escape.");
+               }
+            }
+            return value;
+         }
+
+         void append_utf8(unsigned int cp) {
+            if (cp < 0x80) {
+               scratch.push_back((char)cp);
+            } else if (cp < 0x800) {
+               scratch.push_back((char)(0xc0 | (cp >> 6)));
+               scratch.push_back((char)(0x80 | (cp & 0x3f)));
+            } else if (cp < 0x10000) {
+               scratch.push_back((char)(0xe0 | (cp >> 12)));
+               scratch.push_back((char)(0x80 | ((cp >> 6) & 0x3f)));
+               scratch.push_back((char)(0x80 | (cp & 0x3f)));
+            } else {
+               scratch.push_back((char)(0xf0 | (cp >> 18)));
+               scratch.push_back((char)(0x80 | ((cp >> 12) & 0x3f)));
+               scratch.push_back((char)(0x80 | ((cp >> 6) & 0x3f)));
+               scratch.push_back((char)(0x80 | (cp & 0x3f)));
+            }
+         }
+
+         void parse_escape() {
+            if (ptr == end) {
+               error("Unexpected end of input in string.");
+            }
+
+            switch (*ptr++) {
+            case '"': scratch.push_back('"'); break;
+            case '\\': scratch.push_back('\\'); break;
+            case '/': scratch.push_back('/'); break;
+            case 'b': scratch.push_back('\b'); break;
+            case 'f': scratch.push_back('\f'); break;
+            case 'n': scratch.push_back('\n'); break;
+            case 'r': scratch.push_back('\r'); break;
+            case 't': scratch.push_back('\t'); break;
+            case 'u': {
+               unsigned int cp = parse_hex4();
+               if (cp >= 0xd800 && cp < 0xdc00) {
+                  if (end - ptr < 2 || ptr[0] != '\\' || ptr[1] != 'u') {
+                     error("Unpaired surrogate in unicode escape.");
+                  }
+                  ptr += 2;
+                  unsigned int low = parse_hex4();
+                  if (low < 0xdc00 || low >= 0xe000) {
+                     error("Unpaired surrogate in unicode escape.");
+                  }
+                  cp = 0x10000 + ((cp - 0xd800) << 10) + (low - 0xdc00);
+               } else if (cp >= 0xdc00 && cp < 0xe000) {
+                  error("Unpaired surrogate in unicode escape.");
+               }
+               append_utf8(cp);
+               break;
+            }
+            default:
+               ptr--;
+               error("Invalid escape sequence.");
+            }
+         }
+
+         /**
+          * Parse the string starting at the opening quote.  Strings
+          * without escapes are returned in place; otherwise they are
+          * decoded into the scratch buffer, which is reused.
+          */
+         StringRef parse_string() {
+            const char* start = ++ptr;
+            while (ptr < end && *ptr != '"' && *ptr != '\\') {
+               if ((unsigned char)*ptr < 0x20) {
+                  error("Unescaped control character in string.");
+               }
+               ptr++;
+            }
+
+            if (ptr == end) {
+               error("Unexpected end of input in string.");
+            }
+
+            if (*ptr == '"') {
+               return {start, (size_t)(ptr++ - start)};
+            }
+
+            scratch.assign(start, ptr);
+            for (;;) {
+               if (ptr == end) {
+                  error("Unexpected end of input in string.");
+               }
+
+               char c = *ptr++;
+               if (c == '"') {
+                  break;
+               } else if (c == '\\') {
+                  parse_escape();
+               } else if ((unsigned char)c < 0x20) {
+                  ptr--;
+                  error("Unescaped control character in string.");
+               } else {
+                  scratch.push_back(c);
+               }
+            }
+
+            return {scratch.data(), scratch.size()};
+         }
+
+         void skip_string() {
+            for (ptr++; ptr < end; ptr++) {
+               if (*ptr == '\\') {
+                  ptr++;
+               } else if (*ptr == '"') {
+                  ptr++;
+                  return;
+               }
+            }
+            error("Unexpected end of input in string.");
+         }
+
+         void skip_container() {
+            int depth = 0;
+            while (ptr < end) {
+               switch (*ptr) {
+               case '"':
+                  skip_string();
+                  continue;
+
+               case '{':
+               case '[':
+                  depth++;
+                  break;
+
+               case '}':
+               case ']':
+                  if (--depth == 0) {
+                     ptr++;
+                     return;
+                  }
+                  break;
+               }
+               ptr++;
+            }
+            error("Unexpected end of input.");
+         }
+
+         void skip_value() {
+            switch (peek()) {
+            case '{':
+            case '[':
+               skip_container();
+               break;
+
+            case '"':
+               skip_string();
+               break;
+
+            case 't':
+               parse_literal("true");
+               break;
+
+            case 'f':
+               parse_literal("false");
+               break;
+
+            case 'n':
+               parse_literal("null");
+               break;
+
+            case -1:
+               error("Unexpected end of input.");
+
+            default:
+               parse_number();
+            }
+         }
+
+         [[noreturn]] void error(const string& message) const {
+            int line = 1, column = 1;
+            for (const char* p = begin; p < ptr && p < end; p++) {
+               if (*p == '\n') {
+                  line++;
+                  column = 1;
+               } else {
+                  column++;
+               }
+            }
+
+            throw JsonException(tfm::format(
+               "JSON parse error at line %d, column %d: %s", line, column, message));
+         }
+
+         const char* begin;
+         const char* end;
+         const char* ptr;
+         int max_depth;
+         string scratch;
+      };
+
+      /**
+       * Parse size bytes of JSON at data, as for Parser::parse().
+       */
+      inline bool parse(const char* data, size_t size, Handler& handler,
+                        int max_depth = DEFAULT_MAX_DEPTH) {
+         return Parser(data, size, max_depth).parse(handler);
+      }
+
+      inline bool parse(const string& json, Handler& handler,
+                        int max_depth = DEFAULT_MAX_DEPTH) {
+         return parse(json.data(), json.size(), handler, max_depth);
+      }
+
+      /**
+       * Memory map the given file and parse it, as for Parser::parse().
+       */
+      inline bool parse_file(const string& filename, Handler& handler,
+                             int max_depth = DEFAULT_MAX_DEPTH) {
+         file::MappedFile mapped(filename);
+         return parse(mapped.data(), mapped.size(), handler, max_depth);
+      }
+   }
+}
+
+#endif
@@ -0,0 +1,334 @@
+/*
+ * mapped_matrix.h: A file-backed, memory-mapped matrix for
+ *    trivially copyable element types.
+ *
+ * Author: Lain Supe (lainproliant)
+ */
+#ifndef __LAIN_MAPPED_MATRIX_H
+#define __LAIN_MAPPED_MATRIX_H
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cassert>
+#include <cerrno>
+#include <climits>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <string>
+#include <type_traits>
+
+#include "lain/file.h"
+
+namespace lain {
+   using namespace std;
+
+   /**
+    * The header at the start of every MappedMatrix file.  Cell data
+    * begins at data_offset and is stored in row-major order.
+    */
+   struct MappedMatrixHeader {
+      char magic[8];
+      uint32_t version;
+      uint32_t element_size;
+      uint64_t width;
+      uint64_t height;
+      uint64_t data_offset;
+   };
+
+   /**
+    * A matrix of trivially copyable T backed by an mmap'd file.
+    * Opening a MappedMatrix is constant time regardless of its size:
+    * cells are paged in lazily by the OS as they are accessed, and
+    * writes are flushed back to the file by the OS or by sync().
+    *
+    * Provides the same at()/width()/height()/size()/scan() interface
+    * as Matrix.  A MappedMatrix opened read-only must not be written
+    * to through at(); doing so will raise SIGSEGV.
+    */
+   template<class T>
+   class MappedMatrix {
+   public:
+      static_assert(is_trivially_copyable<T>::value,
+                    "MappedMatrix requires a trivially copyable type.");
+
+      static constexpr const char* MAGIC = "LAINMTX";
+      static const uint32_t VERSION = 1;
+
+      /**
+       * Create a new file of the given dimensions, replacing any
+       * existing file, with every cell set to default_val.
+       */
+      static MappedMatrix<T> create(const string& filename, int width, int height,
+                                    const T& default_val = T()) {
+         const uint64_t data_offset = (sizeof(MappedMatrixHeader) + 63) & ~(uint64_t)63;
+         uint64_t data_end = 0;
+         if (width < 0 || height < 0 || ! data_end_of(data_offset, width, height, data_end)) {
+            throw FileException(tfm::format("Invalid dimensions for mapped matrix '%s': %dx%d",
+                                            filename, width, height));
+         }
+
+         MappedMatrix<T> m;
+         m.writable = true;
+         m.fd = ::open(filename.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+         if (m.fd < 0) {
+            throw FileException(tfm::format("Cannot create mapped matrix '%s': %s",
+                                            filename, strerror(errno)));
+         }
+
+         m.length = data_end;
+         if (ftruncate(m.fd, m.length) != 0) {
+            throw FileException(tfm::format("Cannot size mapped matrix '%s': %s",
+                                            filename, strerror(errno)));
+         }
+
+         m.map(filename);
+
+         MappedMatrixHeader header;
+         memset(&header, 0, sizeof(header));
+         strncpy(header.magic, MAGIC, sizeof(header.magic));
+         header.version = VERSION;
+         header.element_size = sizeof(T);
+         header.width = width;
+         header.height = height;
+         header.data_offset = data_offset;
+         memcpy(m.base, &header, sizeof(header));
+         m.attach(header);
+
+         // ftruncate() leaves the file zero filled and sparse, so
+         // there is nothing to write for an all-zero default.
+         static const T zero = T();
+         if (memcmp(&default_val, &zero, sizeof(T)) != 0) {
+            fill(m.cells, m.cells + m.size(), default_val);
+         }
+
+         return m;
+      }
+
+      /**
+       * Map an existing file created by create().
+       */
+      static MappedMatrix<T> open(const string& filename, bool writable = false) {
+         MappedMatrix<T> m;
+         m.writable = writable;
+         m.fd = ::open(filename.c_str(), writable ? O_RDWR : O_RDONLY);
+         if (m.fd < 0) {
+            throw FileException(tfm::format("Cannot open mapped matrix '%s': %s",
+                                            filename, strerror(errno)));
+         }
+
+         struct stat st;
+         if (fstat(m.fd, &st) != 0) {
+            throw FileException(tfm::format("Cannot stat mapped matrix '%s': %s",
+                                            filename, strerror(errno)));
+         }
+
+         m.length = st.st_size;
+         if (m.length < sizeof(MappedMatrixHeader)) {
+            throw FileException(tfm::format("File is not a mapped matrix: '%s'", filename));
+         }
+
+         m.map(filename);
+
+         MappedMatrixHeader header;
+         memcpy(&header, m.base, sizeof(header));
+         if (strncmp(header.magic, MAGIC, sizeof(header.magic)) != 0 ||
+             header.version != VERSION) {
+            throw FileException(tfm::format("File is not a mapped matrix: '%s'", filename));
+         }
+
+         if (header.element_size != sizeof(T)) {
+            throw FileException(tfm::format(
+               "Mapped matrix '%s' has element size %d, expected %d.",
+               filename, header.element_size, sizeof(T)));
+         }
+
+         uint64_t data_end = 0;
+         if (header.width > INT_MAX || header.height > INT_MAX ||
+             header.data_offset < sizeof(MappedMatrixHeader) ||
+             header.data_offset % alignof(T) != 0 ||
+             ! data_end_of(header.data_offset, header.width, header.height, data_end)) {
+            throw FileException(tfm::format("Mapped matrix '%s' has an invalid header.", filename));
+         }
+
+         if (data_end > m.length) {
+            throw FileException(tfm::format("Mapped matrix '%s' is truncated.", filename));
+         }
+
+         m.attach(header);
+         return m;
+      }
+
+      MappedMatrix(MappedMatrix<T>&& rhs) {
+         *this = move(rhs);
+      }
+
+      MappedMatrix<T>& operator=(MappedMatrix<T>&& rhs) {
+         if (this != &rhs) {
+            close();
+            fd = rhs.fd;
+            base = rhs.base;
+            length = rhs.length;
+            cells = rhs.cells;
+            _width = rhs._width;
+            _height = rhs._height;
+            writable = rhs.writable;
+            rhs.fd = -1;
+            rhs.base = nullptr;
+         }
+         return *this;
+      }
+
+      MappedMatrix(const MappedMatrix<T>&) = delete;
+      MappedMatrix<T>& operator=(const MappedMatrix<T>&) = delete;
+
+      virtual ~MappedMatrix() {
+         close();
+      }
+
+      /**
+       * Get a mutable reference to the element at (x, y).
+       */
+      T& at(int x, int y) {
+         assert(x < _width && y < _height);
+         return cells[(size_t)y * _width + x];
+      }
+
+      /**
+       * Get a const reference to the element at (x, y).
+       */
+      const T& at(int x, int y) const {
+         assert(x < _width && y < _height);
+         return cells[(size_t)y * _width + x];
+      }
+
+      /**
+       * Call f(x, y, cell) for each cell in row order, stopping
+       * early if f returns false.
+       */
+      template<class F>
+      void scan(F f) {
+         for (int y = 0; y < _height; y++) {
+            for (int x = 0; x < _width; x++) {
+               if (! f(x, y, cells[(size_t)y * _width + x])) {
+                  return;
+               }
+            }
+         }
+      }
+
+      template<class F>
+      void scan(F f) const {
+         for (int y = 0; y < _height; y++) {
+            for (int x = 0; x < _width; x++) {
+               if (! f(x, y, cells[(size_t)y * _width + x])) {
+                  return;
+               }
+            }
+         }
+      }
+
+      /**
+       * Flush modified pages back to the file, blocking until the
+       * write has completed.
+       */
+      void sync() {
+         if (writable && msync(base, length, MS_SYNC) != 0) {
+            throw FileException(tfm::format("Failed to sync mapped matrix: %s",
+                                            strerror(errno)));
+         }
+      }
+
+      /**
+       * Hint to the OS that the matrix will be read sequentially,
+       * e.g. before a full scan(), so that it can read ahead.
+       */
+      void advise_sequential() const {
+         madvise(base, length, MADV_SEQUENTIAL);
+      }
+
+      T* data() {
+         return cells;
+      }
+
+      const T* data() const {
+         return cells;
+      }
+
+      int width() const {
+         return _width;
+      }
+
+      int height() const {
+         return _height;
+      }
+
+      size_t size() const {
+         return (size_t)_width * _height;
+      }
+
+   private:
+      MappedMatrix() { }
+
+      /**
+       * Compute the end of the cell data, returning false if it
+       * doesn't fit in a size_t.
+       */
+      static bool data_end_of(uint64_t data_offset, uint64_t width, uint64_t height,
+                              uint64_t& data_end) {
+         const uint64_t max = numeric_limits<size_t>::max();
+         if (height != 0 && width > max / height / sizeof(T)) {
+            return false;
+         }
+
+         const uint64_t data_size = width * height * sizeof(T);
+         if (data_offset > max - data_size) {
+            return false;
+         }
+
+         data_end = data_offset + data_size;
+         return true;
+      }
+
+      void map(const string& filename) {
+         base = mmap(nullptr, length, writable ? PROT_READ | PROT_WRITE : PROT_READ,
+                     MAP_SHARED, fd, 0);
+         if (base == MAP_FAILED) {
+            base = nullptr;
+            throw FileException(tfm::format("Cannot map matrix file '%s': %s",
+                                            filename, strerror(errno)));
+         }
+      }
+
+      void attach(const MappedMatrixHeader& header) {
+         _width = header.width;
+         _height = header.height;
+         cells = reinterpret_cast<T*>(static_cast<char*>(base) + header.data_offset);
+      }
+
+      void close() {
+         if (base != nullptr) {
+            munmap(base, length);
+            base = nullptr;
+         }
+
+         if (fd >= 0) {
+            ::close(fd);
+            fd = -1;
+         }
+      }
+
+      int fd = -1;
+      void* base = nullptr;
+      size_t length = 0;
+      T* cells = nullptr;
+      int _width = 0, _height = 0;
+      bool writable = false;
+   };
+}
+
+#endif
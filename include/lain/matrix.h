@@ -2,36 +2,630 @@
 #define __LAIN_MATRIX_H
 
 #include "exception.h"
+#include "thread_pool.h"
 #include <cstdlib>
 #include <cassert>
-#include <functional>
+#include <iterator>
+#include <type_traits>
+#include <vector>
+#include <algorithm>
 
 namespace lain {
    using namespace std;
 
+   /**
+    * Layout policy storing each row contiguously, one row after
+    * another.  This is the default layout for Matrix.
+    */
+   struct RowMajor {
+      static const int tile_width = 1;
+      static const int tile_height = 1;
+
+      /**
+       * The number of elements allocated per row for a matrix
+       * of the given width.
+       */
+      static int stride_for(int width) {
+         return width;
+      }
+
+      /**
+       * The number of rows allocated for a matrix of the given height.
+       */
+      static int rows_for(int height) {
+         return height;
+      }
+
+      /**
+       * The number of cells in a row which are contiguous in storage,
+       * starting from any multiple of the run length.
+       */
+      static int run_length(int width) {
+         return width;
+      }
+
+      static size_t index(int x, int y, int stride) {
+         return (size_t)y * stride + x;
+      }
+   };
+
+   /**
+    * Layout policy storing the matrix as TW x TH tiles, each of
+    * which is contiguous in memory.  Column sweeps and neighborhood
+    * (stencil) access touch far fewer cache lines than with
+    * RowMajor, at the cost of rows no longer being contiguous.
+    *
+    * TW and TH must be powers of two.  Storage is padded out to
+    * a whole number of tiles in each direction.
+    */
+   template<int TW = 8, int TH = 8>
+   struct Tiled {
+      static_assert(TW > 0 && (TW & (TW - 1)) == 0,
+                    "Tile width must be a power of two.");
+      static_assert(TH > 0 && (TH & (TH - 1)) == 0,
+                    "Tile height must be a power of two.");
+
+      static const int tile_width = TW;
+      static const int tile_height = TH;
+
+      static int stride_for(int width) {
+         return (width + TW - 1) & ~(TW - 1);
+      }
+
+      static int rows_for(int height) {
+         return (height + TH - 1) & ~(TH - 1);
+      }
+
+      static int run_length(int) {
+         return TW;
+      }
+
+      static size_t index(int x, int y, int stride) {
+         const size_t ux = (unsigned)x, uy = (unsigned)y;
+         return (uy & ~(size_t)(TH - 1)) * stride
+            + (ux & ~(size_t)(TW - 1)) * TH
+            + (uy & (TH - 1)) * TW
+            + (ux & (TW - 1));
+      }
+   };
+
+   /**
+    * A lightweight range over a single row or column of a Matrix,
+    * resolving each cell through the matrix's layout policy.
+    * T may be const-qualified for read-only lines.
+    */
+   template<class T, class Layout>
+   class MatrixLine {
+   public:
+      class iterator {
+      public:
+         typedef forward_iterator_tag iterator_category;
+         typedef typename remove_const<T>::type value_type;
+         typedef ptrdiff_t difference_type;
+         typedef T* pointer;
+         typedef T& reference;
+
+         iterator(T* base, int stride, int x, int y, int dx, int dy) :
+            base(base), stride(stride), x(x), y(y), dx(dx), dy(dy) { }
+
+         T& operator*() const {
+            return base[Layout::index(x, y, stride)];
+         }
+
+         T* operator->() const {
+            return &(**this);
+         }
+
+         iterator& operator++() {
+            x += dx;
+            y += dy;
+            return *this;
+         }
+
+         iterator operator++(int) {
+            iterator prev = *this;
+            ++(*this);
+            return prev;
+         }
+
+         bool operator==(const iterator& rhs) const {
+            return x == rhs.x && y == rhs.y;
+         }
+
+         bool operator!=(const iterator& rhs) const {
+            return ! (*this == rhs);
+         }
+
+      private:
+         T* base;
+         int stride, x, y, dx, dy;
+      };
+
+      MatrixLine(T* base, int stride, int x, int y, int dx, int dy, int length) :
+         base(base), stride(stride), x(x), y(y), dx(dx), dy(dy), length(length) { }
+
+      iterator begin() const {
+         return iterator(base, stride, x, y, dx, dy);
+      }
+
+      iterator end() const {
+         return iterator(base, stride, x + dx * length, y + dy * length, dx, dy);
+      }
+
+      T& operator[](int n) const {
+         return base[Layout::index(x + dx * n, y + dy * n, stride)];
+      }
+
+      int size() const {
+         return length;
+      }
+
+   private:
+      T* base;
+      int stride, x, y, dx, dy, length;
+   };
+
+   /**
+    * A non-owning view of a contiguous run of elements, such as a
+    * row of a RowMajor matrix.
+    */
+   template<class T>
+   class Span {
+   public:
+      typedef typename remove_const<T>::type value_type;
+      typedef T* iterator;
+      typedef T* const_iterator;
+
+      Span(T* ptr, int length) : ptr(ptr), length(length) { }
+
+      T* begin() const {
+         return ptr;
+      }
+
+      T* end() const {
+         return ptr + length;
+      }
+
+      T& operator[](int n) const {
+         return ptr[n];
+      }
+
+      T* data() const {
+         return ptr;
+      }
+
+      int size() const {
+         return length;
+      }
+
+   private:
+      T* ptr;
+      int length;
+   };
+
+   /**
+    * A non-owning view of elements spaced a fixed stride apart,
+    * such as a column of a RowMajor matrix.
+    */
+   template<class T>
+   class StridedSpan {
+   public:
+      class iterator {
+      public:
+         typedef random_access_iterator_tag iterator_category;
+         typedef typename remove_const<T>::type value_type;
+         typedef ptrdiff_t difference_type;
+         typedef T* pointer;
+         typedef T& reference;
+
+         iterator(T* ptr, ptrdiff_t stride) : ptr(ptr), stride(stride) { }
+
+         T& operator*() const { return *ptr; }
+         T* operator->() const { return ptr; }
+         T& operator[](ptrdiff_t n) const { return ptr[n * stride]; }
+
+         iterator& operator++() { ptr += stride; return *this; }
+         iterator& operator--() { ptr -= stride; return *this; }
+         iterator operator++(int) { iterator prev = *this; ptr += stride; return prev; }
+         iterator operator--(int) { iterator prev = *this; ptr -= stride; return prev; }
+         iterator& operator+=(ptrdiff_t n) { ptr += n * stride; return *this; }
+         iterator& operator-=(ptrdiff_t n) { ptr -= n * stride; return *this; }
+         iterator operator+(ptrdiff_t n) const { return iterator(ptr + n * stride, stride); }
+         iterator operator-(ptrdiff_t n) const { return iterator(ptr - n * stride, stride); }
+         ptrdiff_t operator-(const iterator& rhs) const { return (ptr - rhs.ptr) / stride; }
+
+         bool operator==(const iterator& rhs) const { return ptr == rhs.ptr; }
+         bool operator!=(const iterator& rhs) const { return ptr != rhs.ptr; }
+         bool operator<(const iterator& rhs) const { return ptr < rhs.ptr; }
+         bool operator>(const iterator& rhs) const { return ptr > rhs.ptr; }
+         bool operator<=(const iterator& rhs) const { return ptr <= rhs.ptr; }
+         bool operator>=(const iterator& rhs) const { return ptr >= rhs.ptr; }
+
+      private:
+         T* ptr;
+         ptrdiff_t stride;
+      };
+
+      typedef typename remove_const<T>::type value_type;
+      typedef iterator const_iterator;
+
+      StridedSpan(T* ptr, int length, int stride) :
+         ptr(ptr), length(length), stride(stride) { }
+
+      iterator begin() const {
+         return iterator(ptr, stride);
+      }
+
+      iterator end() const {
+         return iterator(ptr + (ptrdiff_t)length * stride, stride);
+      }
+
+      T& operator[](int n) const {
+         return ptr[(ptrdiff_t)n * stride];
+      }
+
+      int size() const {
+         return length;
+      }
+
+   private:
+      T* ptr;
+      int length, stride;
+   };
+
+   /**
+    * A range over a row or column of a Tiled matrix.  Within a tile
+    * the iterator steps by a constant offset, and it only jumps when
+    * it crosses into the next tile, so only the first cell is
+    * resolved through Layout::index().  T may be const-qualified.
+    */
+   template<class T, class Layout, bool Column>
+   class TiledLine {
+      static const int step = Column ? Layout::tile_width : 1;
+      static const int run = Column ? Layout::tile_height : Layout::tile_width;
+
+   public:
+      class iterator {
+      public:
+         typedef forward_iterator_tag iterator_category;
+         typedef typename remove_const<T>::type value_type;
+         typedef ptrdiff_t difference_type;
+         typedef T* pointer;
+         typedef T& reference;
+
+         iterator(T* ptr, int left, ptrdiff_t jump) :
+            ptr(ptr), left(left), jump(jump) { }
+
+         T& operator*() const {
+            return *ptr;
+         }
+
+         T* operator->() const {
+            return ptr;
+         }
+
+         iterator& operator++() {
+            if (--left == 0) {
+               left = run;
+               ptr += jump;
+            } else {
+               ptr += step;
+            }
+            return *this;
+         }
+
+         iterator operator++(int) {
+            iterator prev = *this;
+            ++(*this);
+            return prev;
+         }
+
+         bool operator==(const iterator& rhs) const {
+            return ptr == rhs.ptr;
+         }
+
+         bool operator!=(const iterator& rhs) const {
+            return ptr != rhs.ptr;
+         }
+
+      private:
+         T* ptr;
+         int left;
+         ptrdiff_t jump;
+      };
+
+      typedef typename remove_const<T>::type value_type;
+      typedef iterator const_iterator;
+
+      TiledLine(T* base, int stride, int x, int y, int length) :
+         base(base), stride(stride), x(x), y(y), length(length) { }
+
+      iterator begin() const {
+         return iterator(&(*this)[0], run - ((Column ? y : x) & (run - 1)), jump());
+      }
+
+      /**
+       * Stepping past the last cell of a tile lands on the same line
+       * in the next tile, so the end is simply the cell after the last.
+       */
+      iterator end() const {
+         return iterator(&(*this)[length], 0, 0);
+      }
+
+      T& operator[](int n) const {
+         return Column ? base[Layout::index(x, y + n, stride)]
+                       : base[Layout::index(x + n, y, stride)];
+      }
+
+      int size() const {
+         return length;
+      }
+
+   private:
+      /**
+       * The offset from the last cell of a line within a tile to the
+       * first cell of the line in the next tile.
+       */
+      ptrdiff_t jump() const {
+         return Column ? (ptrdiff_t)stride * Layout::tile_height - (ptrdiff_t)(run - 1) * step
+                       : (ptrdiff_t)Layout::tile_width * Layout::tile_height - (run - 1);
+      }
+
+      T* base;
+      int stride, x, y, length;
+   };
+
+   /**
+    * Selects the cheapest range type for the rows and columns of a
+    * matrix with the given layout.  In general these are MatrixLines,
+    * but RowMajor rows are contiguous Spans and its columns are
+    * StridedSpans, and Tiled rows and columns are TiledLines.
+    */
+   template<class T, class Layout>
+   struct matrix_lines {
+      typedef MatrixLine<T, Layout> row_type;
+      typedef MatrixLine<T, Layout> column_type;
+
+      static row_type row(T* base, int stride, int x, int y, int length) {
+         return row_type(base, stride, x, y, 1, 0, length);
+      }
+
+      static column_type column(T* base, int stride, int x, int y, int length) {
+         return column_type(base, stride, x, y, 0, 1, length);
+      }
+   };
+
+   template<class T>
+   struct matrix_lines<T, RowMajor> {
+      typedef Span<T> row_type;
+      typedef StridedSpan<T> column_type;
+
+      static row_type row(T* base, int stride, int x, int y, int length) {
+         return row_type(base + RowMajor::index(x, y, stride), length);
+      }
+
+      static column_type column(T* base, int stride, int x, int y, int length) {
+         return column_type(base + RowMajor::index(x, y, stride), length, stride);
+      }
+   };
+
+   template<class T, int TW, int TH>
+   struct matrix_lines<T, Tiled<TW, TH>> {
+      typedef TiledLine<T, Tiled<TW, TH>, false> row_type;
+      typedef TiledLine<T, Tiled<TW, TH>, true> column_type;
+
+      static row_type row(T* base, int stride, int x, int y, int length) {
+         return row_type(base, stride, x, y, length);
+      }
+
+      static column_type column(T* base, int stride, int x, int y, int length) {
+         return column_type(base, stride, x, y, length);
+      }
+   };
+
+   /**
+    * A non-owning view of a rectangular region of a Matrix, sharing
+    * the matrix's storage.  Coordinates are relative to the region.
+    * T may be const-qualified for read-only views.
+    *
+    * A view is invalidated by anything which reallocates the matrix,
+    * e.g. a resize() beyond its capacity.
+    *
+    * Iterating a view with begin() and end() visits its cells in row
+    * order, so views can be used with STL algorithms and lain::alg.
+    */
+   template<class T, class Layout>
+   class MatrixView {
+   public:
+      typedef matrix_lines<T, Layout> lines;
+      typedef typename lines::row_type row_type;
+      typedef typename lines::column_type column_type;
+      typedef typename remove_const<T>::type value_type;
+
+      class iterator {
+      public:
+         typedef forward_iterator_tag iterator_category;
+         typedef typename remove_const<T>::type value_type;
+         typedef ptrdiff_t difference_type;
+         typedef T* pointer;
+         typedef T& reference;
+
+         iterator(T* base, int stride, int x0, int y0, int width, int x, int y) :
+            base(base), stride(stride), x0(x0), y0(y0), width(width), x(x), y(y) { }
+
+         T& operator*() const {
+            return base[Layout::index(x0 + x, y0 + y, stride)];
+         }
+
+         T* operator->() const {
+            return &base[Layout::index(x0 + x, y0 + y, stride)];
+         }
+
+         iterator& operator++() {
+            if (++x == width) {
+               x = 0;
+               y++;
+            }
+            return *this;
+         }
+
+         iterator operator++(int) {
+            iterator prev = *this;
+            ++(*this);
+            return prev;
+         }
+
+         bool operator==(const iterator& rhs) const {
+            return x == rhs.x && y == rhs.y;
+         }
+
+         bool operator!=(const iterator& rhs) const {
+            return ! (*this == rhs);
+         }
+
+      private:
+         T* base;
+         int stride, x0, y0, width;
+         int x, y;
+      };
+
+      typedef iterator const_iterator;
+
+      MatrixView(T* base, int stride, int x0, int y0, int width, int height) :
+         base(base), stride(stride), x0(x0), y0(y0), _width(width), _height(height) { }
+
+      /**
+       * Get a reference to the element at (x, y) within the view.
+       */
+      T& at(int x, int y) const {
+         assert(x < _width && y < _height);
+         return base[Layout::index(x0 + x, y0 + y, stride)];
+      }
+
+      /**
+       * Call f(x, y, cell) for each cell in the view in row order,
+       * with view-relative coordinates, stopping early if f returns
+       * false.
+       */
+      template<class F>
+      void scan(F f) const {
+         for (int y = 0; y < _height; y++) {
+            for (int x = 0; x < _width; x++) {
+               if (! f(x, y, base[Layout::index(x0 + x, y0 + y, stride)])) {
+                  return;
+               }
+            }
+         }
+      }
+
+      row_type row(int y) const {
+         assert(y < _height);
+         return lines::row(base, stride, x0, y0 + y, _width);
+      }
+
+      column_type column(int x) const {
+         assert(x < _width);
+         return lines::column(base, stride, x0 + x, y0, _height);
+      }
+
+      /**
+       * Get a view of a region within this view.
+       */
+      MatrixView<T, Layout> view(int x, int y, int width, int height) const {
+         assert(x + width <= _width && y + height <= _height);
+         return MatrixView<T, Layout>(base, stride, x0 + x, y0 + y, width, height);
+      }
+
+      iterator begin() const {
+         return iterator(base, stride, x0, y0, _width, 0, _width > 0 ? 0 : _height);
+      }
+
+      iterator end() const {
+         return iterator(base, stride, x0, y0, _width, 0, _height);
+      }
+
+      int width() const {
+         return _width;
+      }
+
+      int height() const {
+         return _height;
+      }
+
+      int size() const {
+         return _width * _height;
+      }
+
+   private:
+      T* base;
+      int stride, x0, y0, _width, _height;
+   };
+
+   /**
+    * Detects callables usable as cell generators, i.e. invocable
+    * as f(x, y) and yielding something convertible to T.
+    */
+   template<class F, class T, class = void>
+   struct is_cell_generator : false_type { };
+
+   template<class F, class T>
+   struct is_cell_generator<F, T, typename enable_if<is_convertible<
+      decltype(declval<F&>()(0, 0)), T>::value>::type> : true_type { };
+
    /**
     * A wrapper template class for a plain vector providing
     * 2d access semantics and preallocation of a static sized
     * matrix.
+    *
+    * The Layout policy (RowMajor or Tiled<TW, TH>) determines how
+    * cells are arranged in the underlying vector.
+    *
+    * A matrix constructed with a constant default value fills
+    * itself with a single bulk fill, and keeps the value to
+    * initialize cells on clear() and resize().  A generator function
+    * is only used during construction, so a matrix constructed with
+    * one uses T() for clear() and resize().
+    *
+    * Like vector, a matrix may have more capacity than its current
+    * dimensions.  Rows are allocated with a stride of at least the
+    * capacity width, so that resize() can grow in place along either
+    * axis, reallocating only when capacity is exceeded.
     */
-   template<class T>
+   template<class T, class Layout = RowMajor>
    class Matrix {
    public:
+      typedef matrix_lines<T, Layout> lines;
+      typedef matrix_lines<const T, Layout> const_lines;
+      typedef typename lines::row_type row_type;
+      typedef typename lines::column_type column_type;
+      typedef typename const_lines::row_type const_row_type;
+      typedef typename const_lines::column_type const_column_type;
+      typedef MatrixView<T, Layout> view_type;
+      typedef MatrixView<const T, Layout> const_view_type;
+
       /**
-       * Construct a matrix with the given width and height.
+       * Construct a matrix with the given width and height, with
+       * every cell set to default_val.
        */
-      Matrix(int width_in, int height_in,
-             const T& default_val) :
-         Matrix(width_in, height_in, [=](int x, int y) { return default_val; }) {}
+      Matrix(int width_in, int height_in, const T& default_val = T()) :
+         _width(width_in), _height(height_in),
+         _stride(Layout::stride_for(width_in)),
+         _rows(Layout::rows_for(height_in)), default_val(default_val) {
+         vec.assign(storage_size(), default_val);
+      }
 
       /**
-       * Construct a matrix with the given width and height.
+       * Construct a matrix with the given width and height, with
+       * each cell initialized to default_f(x, y).
        */
-      Matrix(int width_in, int height_in,
-             function<T(int, int)> default_f = [](int x, int y) {return T();}) :
-         _width(width_in), _height(height_in), default_f(default_f) {
-         vec.resize(_width * _height);
-         clear();
+      template<class F, class = typename enable_if<
+         is_cell_generator<F, T>::value>::type>
+      Matrix(int width_in, int height_in, F default_f) :
+         _width(width_in), _height(height_in),
+         _stride(Layout::stride_for(width_in)),
+         _rows(Layout::rows_for(height_in)), default_val() {
+         vec.resize(storage_size());
+         fill_with(default_f);
       }
 
       virtual ~Matrix() { }
@@ -40,22 +634,38 @@ namespace lain {
        * Get a mutable reference to the element at (x, y).
        */
       T& at(int x, int y)  {
-         assert(y * _width + x < size());
-         return vec[y * _width + x];
+         assert(x < _width && y < _height);
+         return vec[Layout::index(x, y, _stride)];
       }
 
       /**
        * Get a const reference to the element at (x, y).
        */
       const T& at(int x, int y) const {
-         assert(y * _width + x < size());
-         return vec[y * _width + x];
+         assert(x < _width && y < _height);
+         return vec[Layout::index(x, y, _stride)];
       }
 
-      void scan(function<bool(int, int, T&)> f) {
+      /**
+       * Call f(x, y, cell) for each cell in row order, stopping
+       * early if f returns false.
+       */
+      template<class F>
+      void scan(F f) {
+         for (int y = 0; y < _height; y++) {
+            for (int x = 0; x < _width; x++) {
+               if (! f(x, y, vec[Layout::index(x, y, _stride)])) {
+                  return;
+               }
+            }
+         }
+      }
+
+      template<class F>
+      void scan(F f) const {
          for (int y = 0; y < _height; y++) {
             for (int x = 0; x < _width; x++) {
-               if (! f(x, y, vec[y * _width + x])) {
+               if (! f(x, y, vec[Layout::index(x, y, _stride)])) {
                   return;
                }
             }
@@ -63,26 +673,261 @@ namespace lain {
       }
 
       /**
-       * Resize the matrix so that it is the given width and height.
+       * Scan the matrix one tile at a time, in storage order.  This
+       * visits every cell exactly once like scan(), but in an order
+       * which keeps neighboring cells together in cache.  With the
+       * RowMajor layout this is equivalent to scan().
        */
-      Matrix<T> resize(int width_new, int height_new) const {
-         Matrix<T> m_new(width_new, height_new, default_f);
+      template<class F>
+      void scan_tiles(F f) {
+         const int tw = Layout::tile_width, th = Layout::tile_height;
 
-         for (int y = 0; y < _height && y < height_new; y++) {
-            for (int x = 0; x < _width && x < width_new; x++) {
-               m_new.at(x, y) = at(x, y);
+         for (int ty = 0; ty < _height; ty += th) {
+            for (int tx = 0; tx < _width; tx += tw) {
+               for (int y = ty; y < ty + th && y < _height; y++) {
+                  for (int x = tx; x < tx + tw && x < _width; x++) {
+                     if (! f(x, y, vec[Layout::index(x, y, _stride)])) {
+                        return;
+                     }
+                  }
+               }
             }
          }
+      }
 
-         return m_new;
+      /**
+       * Scan the matrix in parallel bands of rows on the given pool,
+       * calling f(x, y, cell) for each cell.  Cells within a band are
+       * visited in row order, but bands run concurrently.
+       *
+       * If f returns false, the scan is cancelled cooperatively: no new
+       * rows are started, though rows already in progress on other
+       * threads run to completion.
+       *
+       * @return true if every cell was visited, false if cancelled.
+       */
+      template<class F>
+      bool parallel_scan(F f, ThreadPool& pool = ThreadPool::shared()) {
+         atomic<bool> cancelled(false);
+         const int rows = band_rows();
+
+         pool.parallel_for(band_count(), [&](int band) {
+            for (int y = band * rows; y < (band + 1) * rows && y < _height; y++) {
+               if (cancelled.load(memory_order_relaxed)) {
+                  return;
+               }
+
+               for (int x = 0; x < _width; x++) {
+                  if (! f(x, y, vec[Layout::index(x, y, _stride)])) {
+                     cancelled = true;
+                     return;
+                  }
+               }
+            }
+         });
+
+         return ! cancelled;
       }
 
-      void clear() {
-         for (int y = 0; y < _height; y++) {
-            for (int x = 0; x < _width; x++) {
-               vec[y * _width + x] = default_f(x, y);
+      /**
+       * Replace each cell with f(x, y, cell) in parallel on the pool.
+       */
+      template<class F>
+      void parallel_transform(F f, ThreadPool& pool = ThreadPool::shared()) {
+         const int rows = band_rows();
+
+         pool.parallel_for(band_count(), [&](int band) {
+            for (int y = band * rows; y < (band + 1) * rows && y < _height; y++) {
+               for (int x = 0; x < _width; x++) {
+                  T& cell = vec[Layout::index(x, y, _stride)];
+                  cell = f(x, y, const_cast<const T&>(cell));
+               }
+            }
+         });
+      }
+
+      /**
+       * Reduce the matrix in parallel on the pool.  Each band of rows
+       * is folded into its own accumulator, starting from identity, by
+       * acc = f(acc, x, y, cell).  The band accumulators are then
+       * folded together in band order with combine(a, b).
+       *
+       * Bands depend only on the matrix dimensions, never on the pool
+       * or on scheduling, so the result is deterministic even for
+       * non-associative operations such as floating point addition.
+       */
+      template<class R, class F, class C>
+      R parallel_reduce(const R& identity, F f, C combine,
+                        ThreadPool& pool = ThreadPool::shared()) const {
+         // Wrapped so that vector<bool> bit packing can't race.
+         struct Slot { R value; };
+         const int rows = band_rows();
+         vector<Slot> accumulators(band_count(), Slot {identity});
+
+         pool.parallel_for(band_count(), [&](int band) {
+            R acc = identity;
+            for (int y = band * rows; y < (band + 1) * rows && y < _height; y++) {
+               for (int x = 0; x < _width; x++) {
+                  acc = f(acc, x, y, vec[Layout::index(x, y, _stride)]);
+               }
             }
+            accumulators[band].value = move(acc);
+         });
+
+         R result = identity;
+         for (const Slot& acc : accumulators) {
+            result = combine(result, acc.value);
          }
+         return result;
+      }
+
+      /**
+       * Get a range over the cells of row y, from left to right.
+       * For RowMajor matrices this is a contiguous Span.
+       */
+      row_type row(int y) {
+         assert(y < _height);
+         return lines::row(vec.data(), _stride, 0, y, _width);
+      }
+
+      const_row_type row(int y) const {
+         assert(y < _height);
+         return const_lines::row(vec.data(), _stride, 0, y, _width);
+      }
+
+      /**
+       * Get a range over the cells of column x, from top to bottom.
+       * For RowMajor matrices this is a StridedSpan.
+       */
+      column_type column(int x) {
+         assert(x < _width);
+         return lines::column(vec.data(), _stride, x, 0, _height);
+      }
+
+      const_column_type column(int x) const {
+         assert(x < _width);
+         return const_lines::column(vec.data(), _stride, x, 0, _height);
+      }
+
+      /**
+       * Get a non-owning view of the given region of the matrix.
+       */
+      view_type view(int x, int y, int width, int height) {
+         assert(x + width <= _width && y + height <= _height);
+         return view_type(vec.data(), _stride, x, y, width, height);
+      }
+
+      const_view_type view(int x, int y, int width, int height) const {
+         assert(x + width <= _width && y + height <= _height);
+         return const_view_type(vec.data(), _stride, x, y, width, height);
+      }
+
+      /**
+       * Get a non-owning view of the whole matrix.
+       */
+      view_type view() {
+         return view(0, 0, _width, _height);
+      }
+
+      const_view_type view() const {
+         return view(0, 0, _width, _height);
+      }
+
+      /**
+       * Resize the matrix in place so that it is the given width and
+       * height.  Cells within both the old and new bounds keep their
+       * values, and only newly exposed cells are initialized to the
+       * matrix's default value.
+       *
+       * Storage is reallocated only when the new dimensions exceed
+       * the current capacity, in which case capacity at least doubles
+       * along the overflowing axis, amortizing repeated growth.
+       */
+      Matrix<T, Layout>& resize(int width_new, int height_new) {
+         grow_to_fit(width_new, height_new);
+         const int width_old = _width, height_old = _height;
+         _width = width_new;
+         _height = height_new;
+
+         fill_region(width_old, _width, 0, min(height_old, _height), default_val);
+         fill_region(0, _width, height_old, _height, default_val);
+         return *this;
+      }
+
+      /**
+       * Resize the matrix in place so that it is the given width and
+       * height, initializing newly exposed cells with default_f(x, y).
+       */
+      template<class F>
+      Matrix<T, Layout>& resize(int width_new, int height_new, F default_f) {
+         grow_to_fit(width_new, height_new);
+         const int width_old = _width, height_old = _height;
+         _width = width_new;
+         _height = height_new;
+
+         generate_region(width_old, _width, 0, min(height_old, _height), default_f);
+         generate_region(0, _width, height_old, _height, default_f);
+         return *this;
+      }
+
+      /**
+       * Get a copy of this matrix resized to the given width and height.
+       */
+      Matrix<T, Layout> resized(int width_new, int height_new) const {
+         Matrix<T, Layout> m_new(*this);
+         m_new.resize(width_new, height_new);
+         return m_new;
+      }
+
+      /**
+       * Ensure that the matrix can hold at least width_cap x height_cap
+       * cells without reallocating.
+       */
+      void reserve(int width_cap, int height_cap) {
+         if (width_cap > _stride || height_cap > _rows) {
+            reallocate(max(width_cap, _stride), max(height_cap, _rows));
+         }
+      }
+
+      /**
+       * Release any capacity beyond the current dimensions.
+       */
+      void shrink_to_fit() {
+         if (Layout::stride_for(_width) != _stride || Layout::rows_for(_height) != _rows) {
+            reallocate(_width, _height);
+            vec.shrink_to_fit();
+         }
+      }
+
+      int capacity_width() const {
+         return _stride;
+      }
+
+      int capacity_height() const {
+         return _rows;
+      }
+
+      /**
+       * Reset every cell to the matrix's default value.
+       */
+      void clear() {
+         fill_region(0, _width, 0, _height, default_val);
+      }
+
+      /**
+       * Set every cell to the given value.
+       */
+      void clear(const T& val) {
+         fill_region(0, _width, 0, _height, val);
+      }
+
+      /**
+       * Set each cell to f(x, y).
+       */
+      template<class F, class = typename enable_if<
+         is_cell_generator<F, T>::value>::type>
+      void clear(F f) {
+         fill_with(f);
       }
 
       int width() const {
@@ -94,12 +939,107 @@ namespace lain {
       }
 
       int size() const {
-         return vec.size();
+         return _width * _height;
       }
 
    private:
-      int _width, _height;
-      function<T(int, int)> default_f;
+      /**
+       * The number of rows processed per parallel task: roughly 64k
+       * cells, rounded to whole tiles so bands never share a tile.
+       */
+      int band_rows() const {
+         const int th = Layout::tile_height;
+         int rows = max(1, (1 << 16) / max(1, _width));
+         return (rows + th - 1) / th * th;
+      }
+
+      int band_count() const {
+         return (_height + band_rows() - 1) / band_rows();
+      }
+
+      size_t storage_size() const {
+         return (size_t)_stride * _rows;
+      }
+
+      template<class F>
+      void fill_with(F& f) {
+         generate_region(0, _width, 0, _height, f);
+      }
+
+      template<class F>
+      void generate_region(int x0, int x1, int y0, int y1, F& f) {
+         for (int y = y0; y < y1; y++) {
+            for (int x = x0; x < x1; x++) {
+               vec[Layout::index(x, y, _stride)] = f(x, y);
+            }
+         }
+      }
+
+      /**
+       * Fill the cells in [x0, x1) x [y0, y1) with val, one contiguous
+       * run at a time.
+       */
+      void fill_region(int x0, int x1, int y0, int y1, const T& val) {
+         if (x0 >= x1) {
+            return;
+         }
+
+         const int run = Layout::run_length(_stride);
+         for (int y = y0; y < y1; y++) {
+            for (int x = x0; x < x1; x = (x / run + 1) * run) {
+               T* dst = &vec[Layout::index(x, y, _stride)];
+               fill(dst, dst + (min((x / run + 1) * run, x1) - x), val);
+            }
+         }
+      }
+
+      /**
+       * Grow capacity as needed to hold width_new x height_new cells,
+       * at least doubling capacity along each axis which overflows.
+       */
+      void grow_to_fit(int width_new, int height_new) {
+         if (width_new > _stride || height_new > _rows) {
+            reallocate(width_new > _stride ? max(width_new, _stride * 2) : _stride,
+                       height_new > _rows ? max(height_new, _rows * 2) : _rows);
+         }
+      }
+
+      /**
+       * Reallocate storage for the given capacity, moving the cells
+       * within the current dimensions a contiguous run at a time.
+       */
+      void reallocate(int width_cap, int height_cap) {
+         const int stride_new = Layout::stride_for(width_cap);
+         const int rows_new = Layout::rows_for(height_cap);
+         const int width_keep = min(_width, width_cap);
+         const int height_keep = min(_height, height_cap);
+
+         if (stride_new == _stride) {
+            // Cell indices depend only on the stride, so rows can
+            // simply be added or removed at the end of storage.
+            vec.resize((size_t)stride_new * rows_new, default_val);
+
+         } else {
+            vector<T> vec_new((size_t)stride_new * rows_new, default_val);
+            const int run = Layout::run_length(_stride);
+
+            for (int y = 0; y < height_keep; y++) {
+               for (int x = 0; x < width_keep; x += run) {
+                  T* src = &vec[Layout::index(x, y, _stride)];
+                  std::move(src, src + min(run, width_keep - x),
+                            &vec_new[Layout::index(x, y, stride_new)]);
+               }
+            }
+
+            vec.swap(vec_new);
+         }
+
+         _stride = stride_new;
+         _rows = rows_new;
+      }
+
+      int _width, _height, _stride, _rows;
+      T default_val;
       vector<T> vec;
    };
 }
@@ -0,0 +1,479 @@
+/*
+ * matrix_io.h: Compact binary serialization for matrices of
+ *    trivially copyable types, streamed one band of rows at a time.
+ *
+ * Stream format (native byte order, checked on load):
+ *
+ *    header:  magic "LMTXSTRM", byte order mark, version,
+ *             element size, width, height, rows per band, flags
+ *    band*:   rows, raw size, stored size, encoding, Adler-32 of
+ *             the raw bytes, followed by the stored bytes
+ *
+ * Bands are either stored raw or run-length encoded per element,
+ * whichever is smaller.  Writers and readers only ever hold a single
+ * band in memory, so a matrix can be saved or loaded without a
+ * second full copy of it.
+ *
+ * Author: Lain Supe (lainproliant)
+ */
+#ifndef __LAIN_MATRIX_IO_H
+#define __LAIN_MATRIX_IO_H
+
+#include <algorithm>
+#include <climits>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <type_traits>
+#include <vector>
+
+#include "lain/exception.h"
+#include "lain/file.h"
+#include "lain/matrix.h"
+
+namespace lain {
+   using namespace std;
+
+   class MatrixIOException : public Exception {
+   public:
+      using Exception::Exception;
+   };
+
+   namespace matrix_io {
+      const char MAGIC[8] = {'L', 'M', 'T', 'X', 'S', 'T', 'R', 'M'};
+      const uint32_t BYTE_ORDER_MARK = 0x01020304;
+      const uint32_t VERSION = 1;
+      const uint32_t FLAG_COMPRESS = 0x1;
+
+      const uint32_t ENCODING_RAW = 0;
+      const uint32_t ENCODING_RLE = 1;
+
+      struct Header {
+         char magic[8];
+         uint32_t byte_order;
+         uint32_t version;
+         uint32_t element_size;
+         uint32_t width;
+         uint32_t height;
+         uint32_t band_rows;
+         uint32_t flags;
+      };
+
+      struct BandHeader {
+         uint32_t rows;
+         uint32_t raw_size;
+         uint32_t stored_size;
+         uint32_t encoding;
+         uint32_t checksum;
+      };
+
+      inline uint32_t adler32(const char* data, size_t len) {
+         const uint32_t MOD = 65521;
+         uint32_t a = 1, b = 0;
+
+         while (len > 0) {
+            // 5552 is the largest block which can't overflow b.
+            size_t block = min(len, (size_t)5552);
+            len -= block;
+            for (size_t x = 0; x < block; x++) {
+               a += (unsigned char)data[x];
+               b += a;
+            }
+            data += block;
+            a %= MOD;
+            b %= MOD;
+         }
+
+         return (b << 16) | a;
+      }
+
+      /**
+       * Run-length encode count elements of size elem_size.  Each run
+       * starts with a control byte c: if c < 128, c + 1 literal
+       * elements follow; otherwise one element follows which is
+       * repeated c - 126 times.
+       */
+      inline void rle_encode(const char* src, size_t count, size_t elem_size,
+                             vector<char>& dst) {
+         auto same = [&](size_t a, size_t b) {
+            return memcmp(src + a * elem_size, src + b * elem_size, elem_size) == 0;
+         };
+
+         size_t x = 0;
+         while (x < count) {
+            size_t run = 1;
+            while (x + run < count && run < 129 && same(x, x + run)) {
+               run++;
+            }
+
+            if (run >= 2) {
+               dst.push_back((char)(run + 126));
+               dst.insert(dst.end(), src + x * elem_size, src + (x + 1) * elem_size);
+               x += run;
+
+            } else {
+               size_t literal = 1;
+               while (x + literal < count && literal < 128 &&
+                      ! (x + literal + 1 < count && same(x + literal, x + literal + 1))) {
+                  literal++;
+               }
+
+               dst.push_back((char)(literal - 1));
+               dst.insert(dst.end(), src + x * elem_size, src + (x + literal) * elem_size);
+               x += literal;
+            }
+         }
+      }
+
+      inline void rle_decode(const char* src, size_t src_size, size_t elem_size,
+                             char* dst, size_t dst_size) {
+         const char* end = src + src_size;
+         size_t written = 0;
+
+         while (src < end) {
+            unsigned char c = *src++;
+            size_t count = c < 128 ? c + 1 : c - 126;
+            size_t bytes = (c < 128 ? count : 1) * elem_size;
+
+            if (src + bytes > end || written + count * elem_size > dst_size) {
+               throw MatrixIOException("Corrupt run-length encoded band.");
+            }
+
+            if (c < 128) {
+               memcpy(dst + written, src, bytes);
+               written += bytes;
+
+            } else {
+               for (size_t n = 0; n < count; n++) {
+                  memcpy(dst + written, src, elem_size);
+                  written += elem_size;
+               }
+            }
+            src += bytes;
+         }
+
+         if (written != dst_size) {
+            throw MatrixIOException("Run-length encoded band has the wrong size.");
+         }
+      }
+   }
+
+   /**
+    * Writes a matrix to a binary stream one row at a time, buffering
+    * and emitting a band of rows at a time.
+    */
+   template<class T>
+   class MatrixWriter {
+   public:
+      static_assert(is_trivially_copyable<T>::value,
+                    "MatrixWriter requires a trivially copyable type.");
+
+      /**
+       * @param out The stream to write to.
+       * @param width The width of the matrix.
+       * @param height The height of the matrix.
+       * @param compress Run-length encode bands where it saves space.
+       * @param band_rows Rows per band, or 0 to use bands of about 1MB.
+       */
+      MatrixWriter(ostream& out, int width, int height, bool compress = false,
+                   int band_rows = 0) :
+         out(out), _width(width), _height(height), compress(compress),
+         band_rows(band_rows > 0 ? band_rows :
+                   max(1, (int)((1 << 20) / max((size_t)1, width * sizeof(T))))) {
+         if (width < 0 || height < 0) {
+            throw MatrixIOException(tfm::format(
+               "Invalid dimensions for matrix stream: %dx%d", width, height));
+         }
+
+         // Band sizes are stored as 32-bit values.
+         if ((uint64_t)this->band_rows * width * sizeof(T) > UINT32_MAX) {
+            throw MatrixIOException(tfm::format(
+               "Bands of %d rows of width %d are too large for a matrix stream.",
+               this->band_rows, width));
+         }
+
+         matrix_io::Header header;
+         memset(&header, 0, sizeof(header));
+         memcpy(header.magic, matrix_io::MAGIC, sizeof(header.magic));
+         header.byte_order = matrix_io::BYTE_ORDER_MARK;
+         header.version = matrix_io::VERSION;
+         header.element_size = sizeof(T);
+         header.width = width;
+         header.height = height;
+         header.band_rows = this->band_rows;
+         header.flags = compress ? matrix_io::FLAG_COMPRESS : 0;
+         write_bytes(&header, sizeof(header));
+
+         band.reserve((size_t)this->band_rows * width);
+      }
+
+      virtual ~MatrixWriter() { }
+
+      /**
+       * Append the next row, given as any range of width elements.
+       */
+      template<class R>
+      void write_row(const R& row) {
+         if (rows_written + rows_buffered() >= _height) {
+            throw MatrixIOException("Too many rows written to MatrixWriter.");
+         }
+
+         size_t before = band.size();
+         band.insert(band.end(), row.begin(), row.end());
+         if (band.size() - before != (size_t)_width) {
+            throw MatrixIOException(tfm::format(
+               "Row of %d elements written to a matrix of width %d.",
+               band.size() - before, _width));
+         }
+
+         if (rows_buffered() == band_rows) {
+            flush_band();
+         }
+      }
+
+      /**
+       * Write every row of the given matrix.
+       */
+      template<class M>
+      void write_rows(const M& m) {
+         for (int y = 0; y < m.height(); y++) {
+            write_row(m.row(y));
+         }
+      }
+
+      /**
+       * Flush the final band and verify that every row was written.
+       */
+      void finish() {
+         flush_band();
+         if (rows_written != _height) {
+            throw MatrixIOException(tfm::format(
+               "MatrixWriter finished after %d of %d rows.", rows_written, _height));
+         }
+         out.flush();
+      }
+
+   private:
+      int rows_buffered() const {
+         return _width > 0 ? band.size() / _width : 0;
+      }
+
+      void write_bytes(const void* data, size_t len) {
+         if (! out.write(static_cast<const char*>(data), len)) {
+            throw MatrixIOException("Failed to write matrix stream.");
+         }
+      }
+
+      void flush_band() {
+         if (band.empty()) {
+            return;
+         }
+
+         const char* raw = reinterpret_cast<const char*>(band.data());
+         matrix_io::BandHeader header;
+         header.rows = rows_buffered();
+         header.raw_size = band.size() * sizeof(T);
+         header.checksum = matrix_io::adler32(raw, header.raw_size);
+         header.encoding = matrix_io::ENCODING_RAW;
+         header.stored_size = header.raw_size;
+
+         if (compress) {
+            encoded.clear();
+            matrix_io::rle_encode(raw, band.size(), sizeof(T), encoded);
+            if (encoded.size() < header.raw_size) {
+               header.encoding = matrix_io::ENCODING_RLE;
+               header.stored_size = encoded.size();
+               raw = encoded.data();
+            }
+         }
+
+         write_bytes(&header, sizeof(header));
+         write_bytes(raw, header.stored_size);
+         rows_written += header.rows;
+         band.clear();
+      }
+
+      ostream& out;
+      int _width, _height;
+      bool compress;
+      int band_rows;
+      int rows_written = 0;
+      vector<T> band;
+      vector<char> encoded;
+   };
+
+   /**
+    * Reads a matrix written by MatrixWriter one row at a time,
+    * decoding and verifying a band of rows at a time.
+    */
+   template<class T>
+   class MatrixReader {
+   public:
+      static_assert(is_trivially_copyable<T>::value,
+                    "MatrixReader requires a trivially copyable type.");
+
+      MatrixReader(istream& in) : in(in) {
+         matrix_io::Header header;
+         read_bytes(&header, sizeof(header));
+
+         if (memcmp(header.magic, matrix_io::MAGIC, sizeof(header.magic)) != 0) {
+            throw MatrixIOException("Stream is not a matrix stream.");
+         }
+
+         if (header.byte_order != matrix_io::BYTE_ORDER_MARK) {
+            throw MatrixIOException("Matrix stream was written with a different byte order.");
+         }
+
+         if (header.version != matrix_io::VERSION) {
+            throw MatrixIOException(tfm::format(
+               "Unsupported matrix stream version %d.", header.version));
+         }
+
+         if (header.element_size != sizeof(T)) {
+            throw MatrixIOException(tfm::format(
+               "Matrix stream has element size %d, expected %d.",
+               header.element_size, sizeof(T)));
+         }
+
+         if (header.width > INT_MAX || header.height > INT_MAX ||
+             (header.width > 0 && header.height > SIZE_MAX / sizeof(T) / header.width)) {
+            throw MatrixIOException(tfm::format(
+               "Matrix stream has invalid dimensions %dx%d.", header.width, header.height));
+         }
+
+         _width = header.width;
+         _height = header.height;
+      }
+
+      virtual ~MatrixReader() { }
+
+      /**
+       * Read the next row into any range of width elements.
+       */
+      template<class R>
+      void read_row(R&& row) {
+         if (band_pos == band.size()) {
+            read_band();
+         }
+
+         if (row.size() != _width) {
+            throw MatrixIOException(tfm::format(
+               "Row of %d elements read from a matrix of width %d.", row.size(), _width));
+         }
+
+         copy(band.begin() + band_pos, band.begin() + band_pos + _width, row.begin());
+         band_pos += _width;
+         rows_read++;
+      }
+
+      /**
+       * Read every remaining row into the given matrix, which must
+       * already have the stream's dimensions.
+       */
+      template<class M>
+      void read_rows(M& m) {
+         for (int y = rows_read; y < m.height(); y++) {
+            read_row(m.row(y));
+         }
+      }
+
+      int width() const {
+         return _width;
+      }
+
+      int height() const {
+         return _height;
+      }
+
+   private:
+      void read_bytes(void* data, size_t len) {
+         if (! in.read(static_cast<char*>(data), len)) {
+            throw MatrixIOException("Unexpected end of matrix stream.");
+         }
+      }
+
+      void read_band() {
+         if (rows_read >= _height) {
+            throw MatrixIOException("Read past the last row of matrix stream.");
+         }
+
+         matrix_io::BandHeader header;
+         read_bytes(&header, sizeof(header));
+
+         if (header.rows == 0 || header.rows > (uint32_t)(_height - rows_read) ||
+             header.raw_size != (uint64_t)header.rows * _width * sizeof(T)) {
+            throw MatrixIOException("Corrupt band header in matrix stream.");
+         }
+
+         band.resize((size_t)header.rows * _width);
+         char* raw = reinterpret_cast<char*>(band.data());
+
+         if (header.encoding == matrix_io::ENCODING_RAW) {
+            if (header.stored_size != header.raw_size) {
+               throw MatrixIOException("Corrupt band header in matrix stream.");
+            }
+            read_bytes(raw, header.raw_size);
+
+         } else if (header.encoding == matrix_io::ENCODING_RLE) {
+            encoded.resize(header.stored_size);
+            read_bytes(encoded.data(), header.stored_size);
+            matrix_io::rle_decode(encoded.data(), encoded.size(), sizeof(T),
+                                  raw, header.raw_size);
+
+         } else {
+            throw MatrixIOException(tfm::format(
+               "Unknown band encoding %d in matrix stream.", header.encoding));
+         }
+
+         if (matrix_io::adler32(raw, header.raw_size) != header.checksum) {
+            throw MatrixIOException("Checksum mismatch in matrix stream.");
+         }
+
+         band_pos = 0;
+      }
+
+      istream& in;
+      int _width = 0, _height = 0;
+      int rows_read = 0;
+      size_t band_pos = 0;
+      vector<T> band;
+      vector<char> encoded;
+   };
+
+   namespace matrix_io {
+      /**
+       * Save the given matrix to a binary stream.
+       */
+      template<class T, class Layout>
+      void save(const Matrix<T, Layout>& m, ostream& out, bool compress = false) {
+         MatrixWriter<T> writer(out, m.width(), m.height(), compress);
+         writer.write_rows(m);
+         writer.finish();
+      }
+
+      template<class T, class Layout>
+      void save(const Matrix<T, Layout>& m, const string& filename, bool compress = false) {
+         ofstream out = file::open_w(filename, ios::out | ios::binary);
+         save(m, out, compress);
+      }
+
+      /**
+       * Load a matrix from a binary stream.
+       */
+      template<class T, class Layout = RowMajor>
+      Matrix<T, Layout> load(istream& in) {
+         MatrixReader<T> reader(in);
+         Matrix<T, Layout> m(reader.width(), reader.height());
+         reader.read_rows(m);
+         return m;
+      }
+
+      template<class T, class Layout = RowMajor>
+      Matrix<T, Layout> load(const string& filename) {
+         ifstream in = file::open_r(filename, ios::in | ios::binary);
+         return load<T, Layout>(in);
+      }
+   }
+}
+
+#endif
@@ -0,0 +1,440 @@
+/*
+ * matrix_math.h: Bulk numeric operations over Matrix<T> for
+ *    arithmetic element types.
+ *
+ * Each operation runs a tight loop over raw row pointers, which the
+ * compiler auto-vectorizes.  On x86 with GCC or Clang, every kernel
+ * is compiled twice, once for the baseline target and once for AVX2,
+ * and the AVX2 version is selected at runtime if the CPU supports it.
+ * Define LAIN_MATH_NO_SIMD to disable runtime dispatch.
+ *
+ * Kernels never contract multiplies and adds into FMA instructions,
+ * so both versions give bit-identical results.
+ *
+ * Author: Lain Supe (lainproliant)
+ */
+#ifndef __LAIN_MATRIX_MATH_H
+#define __LAIN_MATRIX_MATH_H
+
+#include <algorithm>
+#include <type_traits>
+
+#include "lain/matrix.h"
+
+#if (defined(__GNUC__) || defined(__clang__)) && \
+    (defined(__x86_64__) || defined(__i386__)) && ! defined(LAIN_MATH_NO_SIMD)
+#define LAIN_MATH_DISPATCH_AVX2
+#endif
+
+// GCC only vectorizes loops with runtime alias checks at -O3, so the
+// kernels request it explicitly.  Clang vectorizes these at -O2.  The
+// AVX2 target doesn't include FMA, and GCC is also told not to
+// contract, so that results don't depend on the target.
+#if defined(__GNUC__) && ! defined(__clang__)
+#define LAIN_MATH_VECTORIZE __attribute__((optimize("O3", "fp-contract=off")))
+#else
+#define LAIN_MATH_VECTORIZE
+#endif
+
+// Element and combine functions are forced inline so that kernels
+// still vectorize when the rest of the program is built at -O0.
+#if defined(__GNUC__) || defined(__clang__)
+#define LAIN_MATH_INLINE __attribute__((always_inline))
+#else
+#define LAIN_MATH_INLINE
+#endif
+
+namespace lain {
+   namespace mat {
+      using namespace std;
+
+      namespace impl {
+         /**
+          * The number of independent accumulators used by reductions.
+          * Fixed so that floating point results don't depend on the
+          * instruction set selected at runtime.
+          */
+         const size_t REDUCE_LANES = 8;
+
+         template<class T, class F>
+         LAIN_MATH_INLINE inline void generate_loop(T* out, size_t n, F f) {
+            for (size_t i = 0; i < n; i++) {
+               out[i] = f(i);
+            }
+         }
+
+         /**
+          * Fold whole groups of REDUCE_LANES elements into acc.  The
+          * lanes are kept in a local array while looping, so that the
+          * compiler can hold them in vector registers.
+          */
+         template<class T, class F, class C>
+         LAIN_MATH_INLINE inline void reduce_loop(T* acc, size_t n, F f, C combine) {
+            T lanes[REDUCE_LANES];
+            for (size_t j = 0; j < REDUCE_LANES; j++) {
+               lanes[j] = acc[j];
+            }
+            for (size_t i = 0; i + REDUCE_LANES <= n; i += REDUCE_LANES) {
+               for (size_t j = 0; j < REDUCE_LANES; j++) {
+                  lanes[j] = combine(lanes[j], f(i + j));
+               }
+            }
+            for (size_t j = 0; j < REDUCE_LANES; j++) {
+               acc[j] = lanes[j];
+            }
+         }
+
+         template<class T, class F>
+         LAIN_MATH_VECTORIZE
+         void generate_generic(T* out, size_t n, F f) {
+            generate_loop(out, n, f);
+         }
+
+         template<class T, class F, class C>
+         LAIN_MATH_VECTORIZE
+         void reduce_generic(T* acc, size_t n, F f, C combine) {
+            reduce_loop(acc, n, f, combine);
+         }
+
+#ifdef LAIN_MATH_DISPATCH_AVX2
+         inline bool has_avx2() {
+            static const bool avx2 = __builtin_cpu_supports("avx2");
+            return avx2;
+         }
+
+         template<class T, class F>
+         LAIN_MATH_VECTORIZE __attribute__((target("avx2")))
+         void generate_avx2(T* out, size_t n, F f) {
+            generate_loop(out, n, f);
+         }
+
+         template<class T, class F, class C>
+         LAIN_MATH_VECTORIZE __attribute__((target("avx2")))
+         void reduce_avx2(T* acc, size_t n, F f, C combine) {
+            reduce_loop(acc, n, f, combine);
+         }
+#endif
+
+         /**
+          * Set out[i] = f(i) for each i in [0, n).
+          */
+         template<class T, class F>
+         inline void generate(T* out, size_t n, F f) {
+#ifdef LAIN_MATH_DISPATCH_AVX2
+            if (has_avx2()) {
+               generate_avx2(out, n, f);
+               return;
+            }
+#endif
+            generate_generic(out, n, f);
+         }
+
+         /**
+          * Fold f(i) for each i in [0, n) into the REDUCE_LANES
+          * accumulators in acc, lane i % REDUCE_LANES at a time, then
+          * fold the remainder and all lanes into acc[0].
+          */
+         template<class T, class F, class C>
+         inline void reduce(T* acc, size_t n, F f, C combine) {
+#ifdef LAIN_MATH_DISPATCH_AVX2
+            if (has_avx2()) {
+               reduce_avx2(acc, n, f, combine);
+            } else {
+               reduce_generic(acc, n, f, combine);
+            }
+#else
+            reduce_generic(acc, n, f, combine);
+#endif
+            for (size_t i = n - n % REDUCE_LANES; i < n; i++) {
+               acc[0] = combine(acc[0], f(i));
+            }
+            for (size_t j = 1; j < REDUCE_LANES; j++) {
+               acc[0] = combine(acc[0], acc[j]);
+            }
+         }
+
+         template<class T>
+         bool contiguous(const Matrix<T>& m) {
+            return m.capacity_width() == m.width();
+         }
+
+         template<class T>
+         void check_shape(const Matrix<T>& a, const Matrix<T>& b, const char* op) {
+            if (a.width() != b.width() || a.height() != b.height()) {
+               throw ValueException(tfm::format(
+                  "Matrix shape mismatch in %s: %dx%d vs %dx%d.",
+                  op, a.width(), a.height(), b.width(), b.height()));
+            }
+         }
+
+         /**
+          * Call f(out_row, a_row, n) for each contiguous run shared by
+          * out and a, using a single run when both are unpadded.
+          */
+         template<class T, class F>
+         void for_each_run(Matrix<T>& out, const Matrix<T>& a, F f) {
+            if (out.height() == 0 || out.width() == 0) {
+               return;
+            }
+
+            if (contiguous(out) && contiguous(a)) {
+               f(out.row(0).data(), a.row(0).data(), (size_t)out.size());
+
+            } else {
+               for (int y = 0; y < out.height(); y++) {
+                  f(out.row(y).data(), a.row(y).data(), (size_t)out.width());
+               }
+            }
+         }
+
+         template<class T, class F>
+         void for_each_run(Matrix<T>& out, const Matrix<T>& a, const Matrix<T>& b, F f) {
+            if (out.height() == 0 || out.width() == 0) {
+               return;
+            }
+
+            if (contiguous(out) && contiguous(a) && contiguous(b)) {
+               f(out.row(0).data(), a.row(0).data(), b.row(0).data(), (size_t)out.size());
+
+            } else {
+               for (int y = 0; y < out.height(); y++) {
+                  f(out.row(y).data(), a.row(y).data(), b.row(y).data(), (size_t)out.width());
+               }
+            }
+         }
+
+         template<class T, class C>
+         T reduce_matrix(const Matrix<T>& a, const T& init, C combine) {
+            T result = init;
+
+            auto reduce_run = [&](const T* p, size_t n) {
+               T acc[REDUCE_LANES];
+               fill(acc, acc + REDUCE_LANES, init);
+               reduce(acc, n, [p](size_t i) LAIN_MATH_INLINE { return p[i]; }, combine);
+               result = combine(result, acc[0]);
+            };
+
+            if (a.size() == 0) {
+               return init;
+
+            } else if (contiguous(a)) {
+               reduce_run(a.row(0).data(), a.size());
+
+            } else {
+               for (int y = 0; y < a.height(); y++) {
+                  reduce_run(a.row(y).data(), a.width());
+               }
+            }
+
+            return result;
+         }
+
+         /**
+          * Convolve src with an N x N kernel into out, clamping
+          * coordinates at the edges of src.
+          */
+         template<int N, class T>
+         void convolve(const Matrix<T>& src, const T* kernel, Matrix<T>& out) {
+            static_assert(N % 2 == 1, "Convolution kernel size must be odd.");
+            const int R = N / 2;
+            const int w = src.width(), h = src.height();
+            check_shape(src, out, "convolve");
+
+            if (&src == &out) {
+               throw ValueException("Convolution output must not alias its input.");
+            }
+
+            for (int y = 0; y < h; y++) {
+               const T* rows[N];
+               for (int k = 0; k < N; k++) {
+                  rows[k] = src.row(min(max(y + k - R, 0), h - 1)).data();
+               }
+
+               auto at_clamped = [&](int x) {
+                  T acc = T();
+                  for (int ky = 0; ky < N; ky++) {
+                     for (int kx = 0; kx < N; kx++) {
+                        acc += kernel[ky * N + kx] * rows[ky][min(max(x + kx - R, 0), w - 1)];
+                     }
+                  }
+                  return acc;
+               };
+
+               T* out_row = out.row(y).data();
+               const int interior = max(w - 2 * R, 0);
+
+               for (int x = 0; x < min(R, w); x++) {
+                  out_row[x] = at_clamped(x);
+               }
+
+               generate(out_row + R, interior, [&rows, kernel](size_t i) LAIN_MATH_INLINE {
+                  T acc = T();
+                  for (int ky = 0; ky < N; ky++) {
+                     for (int kx = 0; kx < N; kx++) {
+                        acc += kernel[ky * N + kx] * rows[ky][i + kx];
+                     }
+                  }
+                  return acc;
+               });
+
+               for (int x = max(R + interior, R); x < w; x++) {
+                  out_row[x] = at_clamped(x);
+               }
+            }
+         }
+      }
+
+      /**
+       * out = a + b.  out may be the same matrix as a or b.
+       */
+      template<class T>
+      void add(const Matrix<T>& a, const Matrix<T>& b, Matrix<T>& out) {
+         static_assert(is_arithmetic<T>::value, "Matrix math requires an arithmetic type.");
+         impl::check_shape(a, b, "add");
+         impl::check_shape(a, out, "add");
+         impl::for_each_run(out, a, b, [](T* o, const T* pa, const T* pb, size_t n) {
+            impl::generate(o, n, [=](size_t i) LAIN_MATH_INLINE { return pa[i] + pb[i]; });
+         });
+      }
+
+      /**
+       * out = a - b.  out may be the same matrix as a or b.
+       */
+      template<class T>
+      void sub(const Matrix<T>& a, const Matrix<T>& b, Matrix<T>& out) {
+         static_assert(is_arithmetic<T>::value, "Matrix math requires an arithmetic type.");
+         impl::check_shape(a, b, "sub");
+         impl::check_shape(a, out, "sub");
+         impl::for_each_run(out, a, b, [](T* o, const T* pa, const T* pb, size_t n) {
+            impl::generate(o, n, [=](size_t i) LAIN_MATH_INLINE { return pa[i] - pb[i]; });
+         });
+      }
+
+      /**
+       * out = a * b, elementwise.  out may be the same matrix as a or b.
+       */
+      template<class T>
+      void mul(const Matrix<T>& a, const Matrix<T>& b, Matrix<T>& out) {
+         static_assert(is_arithmetic<T>::value, "Matrix math requires an arithmetic type.");
+         impl::check_shape(a, b, "mul");
+         impl::check_shape(a, out, "mul");
+         impl::for_each_run(out, a, b, [](T* o, const T* pa, const T* pb, size_t n) {
+            impl::generate(o, n, [=](size_t i) LAIN_MATH_INLINE { return pa[i] * pb[i]; });
+         });
+      }
+
+      /**
+       * out = a * b + out, elementwise.
+       */
+      template<class T>
+      void fma(const Matrix<T>& a, const Matrix<T>& b, Matrix<T>& out) {
+         static_assert(is_arithmetic<T>::value, "Matrix math requires an arithmetic type.");
+         impl::check_shape(a, b, "fma");
+         impl::check_shape(a, out, "fma");
+         impl::for_each_run(out, a, b, [](T* o, const T* pa, const T* pb, size_t n) {
+            impl::generate(o, n, [=](size_t i) LAIN_MATH_INLINE { return pa[i] * pb[i] + o[i]; });
+         });
+      }
+
+      /**
+       * out = a + s for each element.  out may be the same matrix as a.
+       */
+      template<class T>
+      void add_scalar(const Matrix<T>& a, const T& s, Matrix<T>& out) {
+         static_assert(is_arithmetic<T>::value, "Matrix math requires an arithmetic type.");
+         impl::check_shape(a, out, "add_scalar");
+         impl::for_each_run(out, a, [s](T* o, const T* pa, size_t n) {
+            impl::generate(o, n, [=](size_t i) LAIN_MATH_INLINE { return pa[i] + s; });
+         });
+      }
+
+      /**
+       * out = a * s for each element.  out may be the same matrix as a.
+       */
+      template<class T>
+      void mul_scalar(const Matrix<T>& a, const T& s, Matrix<T>& out) {
+         static_assert(is_arithmetic<T>::value, "Matrix math requires an arithmetic type.");
+         impl::check_shape(a, out, "mul_scalar");
+         impl::for_each_run(out, a, [s](T* o, const T* pa, size_t n) {
+            impl::generate(o, n, [=](size_t i) LAIN_MATH_INLINE { return pa[i] * s; });
+         });
+      }
+
+      /**
+       * The sum of all elements.  Floating point sums are accumulated
+       * in a fixed number of lanes, so they are deterministic but may
+       * differ slightly from a sequential sum.
+       */
+      template<class T>
+      T sum(const Matrix<T>& a) {
+         static_assert(is_arithmetic<T>::value, "Matrix math requires an arithmetic type.");
+         return impl::reduce_matrix(a, T(), [](T x, T y) LAIN_MATH_INLINE { return x + y; });
+      }
+
+      /**
+       * The smallest element.  The matrix must not be empty.
+       */
+      template<class T>
+      T minimum(const Matrix<T>& a) {
+         static_assert(is_arithmetic<T>::value, "Matrix math requires an arithmetic type.");
+         assert(a.size() > 0);
+         return impl::reduce_matrix(a, a.at(0, 0), [](T x, T y) LAIN_MATH_INLINE { return y < x ? y : x; });
+      }
+
+      /**
+       * The largest element.  The matrix must not be empty.
+       */
+      template<class T>
+      T maximum(const Matrix<T>& a) {
+         static_assert(is_arithmetic<T>::value, "Matrix math requires an arithmetic type.");
+         assert(a.size() > 0);
+         return impl::reduce_matrix(a, a.at(0, 0), [](T x, T y) LAIN_MATH_INLINE { return y > x ? y : x; });
+      }
+
+      /**
+       * Get the transpose of a, copied in cache-sized blocks.
+       */
+      template<class T>
+      Matrix<T> transpose(const Matrix<T>& a) {
+         const int B = 32;
+         Matrix<T> result(a.height(), a.width());
+
+         for (int by = 0; by < a.height(); by += B) {
+            for (int bx = 0; bx < a.width(); bx += B) {
+               for (int x = bx; x < min(bx + B, a.width()); x++) {
+                  T* dst = result.row(x).data();
+                  for (int y = by; y < min(by + B, a.height()); y++) {
+                     dst[y] = a.row(y)[x];
+                  }
+               }
+            }
+         }
+
+         return result;
+      }
+
+      /**
+       * Convolve src with a 3x3 kernel in row-major order into out,
+       * clamping at the edges.  out must be a distinct matrix of the
+       * same dimensions.
+       */
+      template<class T>
+      void convolve3x3(const Matrix<T>& src, const T (&kernel)[9], Matrix<T>& out) {
+         static_assert(is_arithmetic<T>::value, "Matrix math requires an arithmetic type.");
+         impl::convolve<3>(src, kernel, out);
+      }
+
+      /**
+       * Convolve src with a 5x5 kernel in row-major order into out,
+       * clamping at the edges.  out must be a distinct matrix of the
+       * same dimensions.
+       */
+      template<class T>
+      void convolve5x5(const Matrix<T>& src, const T (&kernel)[25], Matrix<T>& out) {
+         static_assert(is_arithmetic<T>::value, "Matrix math requires an arithmetic type.");
+         impl::convolve<5>(src, kernel, out);
+      }
+   }
+}
+
+#endif
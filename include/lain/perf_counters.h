@@ -0,0 +1,145 @@
+/*
+ * perf_counters.h: Hardware and software performance counters for
+ *    the calling thread, via perf_event_open(2) on Linux.
+ *
+ * Author: Lain Supe (lainproliant)
+ */
+#ifndef __LAIN_PERF_COUNTERS_H
+#define __LAIN_PERF_COUNTERS_H
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace lain {
+   using namespace std;
+
+   /**
+    * A set of performance counters for the calling thread: cycles,
+    * instructions, cache misses, branch misses and page faults.
+    *
+    * Each counter is opened independently, and counters which can't
+    * be opened (e.g. in a VM without a PMU, or when
+    * perf_event_paranoid forbids it) are silently left out.  If none
+    * can be opened, or on platforms other than Linux, available()
+    * is false and read() returns an empty map.
+    */
+   class PerfCounters {
+   public:
+      PerfCounters() {
+#ifdef __linux__
+         static const Spec specs[] = {
+            {"cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+            {"instructions", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+            {"cache_misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+            {"branch_misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+            {"page_faults", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS}
+         };
+
+         for (const Spec& spec : specs) {
+            struct perf_event_attr attr;
+            memset(&attr, 0, sizeof(attr));
+            attr.size = sizeof(attr);
+            attr.type = spec.type;
+            attr.config = spec.config;
+            attr.disabled = 1;
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+            int fd = syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+            if (fd >= 0) {
+               counters.push_back({spec.name, fd});
+            }
+         }
+#endif
+      }
+
+      PerfCounters(const PerfCounters&) = delete;
+      PerfCounters& operator=(const PerfCounters&) = delete;
+
+      virtual ~PerfCounters() {
+#ifdef __linux__
+         for (const Counter& counter : counters) {
+            close(counter.fd);
+         }
+#endif
+      }
+
+      /**
+       * Whether any counters could be opened.
+       */
+      bool available() const {
+         return ! counters.empty();
+      }
+
+      /**
+       * Reset all counters to zero and start counting.
+       */
+      void start() {
+#ifdef __linux__
+         for (const Counter& counter : counters) {
+            ioctl(counter.fd, PERF_EVENT_IOC_RESET, 0);
+            ioctl(counter.fd, PERF_EVENT_IOC_ENABLE, 0);
+         }
+#endif
+      }
+
+      /**
+       * Stop counting, leaving the counts to be read().
+       */
+      void stop() {
+#ifdef __linux__
+         for (const Counter& counter : counters) {
+            ioctl(counter.fd, PERF_EVENT_IOC_DISABLE, 0);
+         }
+#endif
+      }
+
+      /**
+       * The count of each available counter since start().  If the
+       * kernel multiplexed a counter, its count is scaled up by the
+       * fraction of time it was actually running.
+       */
+      map<string, double> read() const {
+         map<string, double> values;
+
+#ifdef __linux__
+         for (const Counter& counter : counters) {
+            uint64_t data[3] = {0, 0, 0};
+            if (::read(counter.fd, data, sizeof(data)) != sizeof(data) || data[2] == 0) {
+               continue;
+            }
+            values[counter.name] = (double)data[0] * data[1] / data[2];
+         }
+#endif
+
+         return values;
+      }
+
+   private:
+      struct Spec {
+         const char* name;
+         uint32_t type;
+         uint64_t config;
+      };
+
+      struct Counter {
+         string name;
+         int fd;
+      };
+
+      vector<Counter> counters;
+   };
+}
+
+#endif
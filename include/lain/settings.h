@@ -11,12 +11,14 @@
  * Date: Wednesday, Jan 14 2015
  */
 #pragma once
+#include <algorithm>
 #include <fstream>
 #include <memory>
 
 #include "lain/maps.h"
 #include "lain/exception.h"
 #include "lain/file.h"
+#include "lain/json_stream.h"
 #include "tinyformat/tinyformat.h"
 #include "picojson/picojson.h"
 
@@ -37,43 +39,97 @@ namespace lain {
          obj[name] = json_value;
       }
 
+      /**
+       * The result of a non-throwing lookup.
+       */
+      enum class LookupStatus {
+         FOUND,
+         MISSING,
+         WRONG_TYPE
+      };
+
+      /**
+       * Assign value to result if it has type T, returning whether it
+       * did.
+       */
+      template <class T>
+      bool try_convert(const pj::value& value, T& result) {
+         if (! value.is<T>()) {
+            return false;
+         }
+
+         result = value.get<T>();
+         return true;
+      }
+
+      template <>
+      inline bool try_convert<int>(const pj::value& value, int& result) {
+         if (! value.is<double>()) {
+            return false;
+         }
+
+         result = (int)value.get<double>();
+         return true;
+      }
+
+      /**
+       * Look up name without throwing, with a single search of the
+       * object.  result is only assigned if the value is found and has
+       * the expected type.
+       */
+      template <class T>
+      LookupStatus try_get_value(const pj::value& obj_value, const string& name, T& result) {
+         if (! obj_value.is<pj::object>()) {
+            return LookupStatus::MISSING;
+         }
+
+         const pj::object& obj = obj_value.get<pj::object>();
+         auto iter = obj.find(name);
+         if (iter == obj.end()) {
+            return LookupStatus::MISSING;
+         }
+
+         return try_convert<T>(iter->second, result) ? LookupStatus::FOUND : LookupStatus::WRONG_TYPE;
+      }
+
       template <class T>
       T get_value(const pj::value& obj_value, const string& name) {
-         if (! obj_value.contains(name)) {
+         T result;
+
+         switch (try_get_value<T>(obj_value, name, result)) {
+         case LookupStatus::MISSING:
             throw SettingsException(tfm::format(
                "Missing value for key '%s'.", name));
-         }
 
-         pj::value value = obj_value.get(name);
-         if (! value.is<T>()) {
+         case LookupStatus::WRONG_TYPE:
             throw SettingsException(tfm::format(
                "Unexpected value type for key '%s'.", name));
-         }
 
-         return value.get<T>();
+         default:
+            return result;
+         }
       }
 
       template <class T>
       T get_value_or_default(const pj::value& obj_value,
                              const string& name,
                              const T& default_value) {
-         try {
-            return get_value<T>(obj_value, name);
-
-         } catch (const SettingsException& e) {
-            return default_value;
+         T result;
+         if (try_get_value<T>(obj_value, name, result) == LookupStatus::FOUND) {
+            return result;
          }
+         return default_value;
       }
 
       template <class T>
       T get_value(pj::value& obj_value, const string& name, const T& default_value) {
-         try {
-            return get_value<T>(obj_value, name);
-
-         } catch (const SettingsException& e) {
-            set_value(obj_value, name, default_value);
-            return default_value;
+         T result;
+         if (try_get_value<T>(obj_value, name, result) == LookupStatus::FOUND) {
+            return result;
          }
+
+         set_value(obj_value, name, default_value);
+         return default_value;
       }
 
       template <class T>
@@ -88,43 +144,72 @@ namespace lain {
          obj[name] = pj::value(array);
       }
 
+      /**
+       * Look up an array without throwing.  WRONG_TYPE is returned if
+       * name refers to a non-array or to an array with elements of
+       * other types, in which case vec is left unchanged.
+       */
       template<class T>
-      vector<T> get_array(const pj::value& obj_value, const string& name) {
-         vector<T> vec;
+      LookupStatus try_get_array(const pj::value& obj_value, const string& name, vector<T>& vec) {
+         if (! obj_value.is<pj::object>()) {
+            return LookupStatus::MISSING;
+         }
 
-         if (! obj_value.contains(name)) {
-            throw SettingsException(tfm::format(
-               "Missing array for key '%s'.", name));
+         const pj::object& obj = obj_value.get<pj::object>();
+         auto iter = obj.find(name);
+         if (iter == obj.end()) {
+            return LookupStatus::MISSING;
          }
 
-         const pj::value& array_value = obj_value.get(name);
-         if (! array_value.is<pj::array>()) {
-            throw SettingsException(tfm::format("Key '%s' does not refer to an array.", name));
+         if (! iter->second.is<pj::array>()) {
+            return LookupStatus::WRONG_TYPE;
          }
 
-         const pj::array& array = array_value.get<pj::array>();
-         for (pj::value val : array) {
+         const pj::array& array = iter->second.get<pj::array>();
+         vector<T> result;
+         result.reserve(array.size());
+         for (const pj::value& val : array) {
             if (! val.is<T>()) {
-               throw SettingsException(tfm::format(
-                  "Unexpected heterogenous value type in array for key '%s'.", name));
+               return LookupStatus::WRONG_TYPE;
             }
 
-            vec.push_back(val.get<T>());
+            result.push_back(val.get<T>());
          }
 
-         return vec;
+         vec.swap(result);
+         return LookupStatus::FOUND;
+      }
+
+      template<class T>
+      vector<T> get_array(const pj::value& obj_value, const string& name) {
+         vector<T> vec;
+
+         switch (try_get_array<T>(obj_value, name, vec)) {
+         case LookupStatus::MISSING:
+            throw SettingsException(tfm::format(
+               "Missing array for key '%s'.", name));
+
+         case LookupStatus::WRONG_TYPE:
+            if (! obj_value.get(name).is<pj::array>()) {
+               throw SettingsException(tfm::format("Key '%s' does not refer to an array.", name));
+            }
+            throw SettingsException(tfm::format(
+               "Unexpected heterogenous value type in array for key '%s'.", name));
+
+         default:
+            return vec;
+         }
       }
 
       template <class T>
       vector<T> get_array(pj::value& obj_value, const string& name, const vector<T>& default_array) {
-         try {
-            return get_array<T>(obj_value, name);
-
-         } catch (const SettingsException& e) {
-            cerr << e.get_message() << endl;
-            set_array(name, default_array);
-            return default_array;
+         vector<T> vec;
+         if (try_get_array<T>(obj_value, name, vec) == LookupStatus::FOUND) {
+            return vec;
          }
+
+         set_array(obj_value, name, default_array);
+         return default_array;
       }
 
       template <>
@@ -138,6 +223,11 @@ namespace lain {
                   (double)(default_value)));
       }
 
+      template <>
+      inline void set_value<int>(pj::value& obj_value, const string& name, const int& value) {
+         set_value<double>(obj_value, name, value);
+      }
+
       template <>
       inline void set_array<int>(pj::value& obj_value, const string& name, const vector<int>& vec) {
          vector<double> db_vec;
@@ -154,17 +244,307 @@ namespace lain {
       }
 
       template <>
-      inline vector<int> get_array<int>(pj::value& obj_value, const string& name, const vector<int>& default_vec) {
-         try {
-            return get_array<int>(obj_value, name);
+      inline LookupStatus try_get_array<int>(const pj::value& obj_value, const string& name, vector<int>& vec) {
+         vector<double> db_vec;
+         LookupStatus status = try_get_array<double>(obj_value, name, db_vec);
+         if (status == LookupStatus::FOUND) {
+            vec.assign(db_vec.begin(), db_vec.end());
+         }
+         return status;
+      }
 
-         } catch (const SettingsException& e) {
-            set_array(obj_value, name, default_vec);
-            return default_vec;
+      template <>
+      inline vector<int> get_array<int>(pj::value& obj_value, const string& name, const vector<int>& default_vec) {
+         vector<int> vec;
+         if (try_get_array<int>(obj_value, name, vec) == LookupStatus::FOUND) {
+            return vec;
          }
+
+         set_array(obj_value, name, default_vec);
+         return default_vec;
       }
+
+      /**
+       * A json::Handler which builds a picojson document in a single
+       * pass.  If keys is not empty, only those keys of the root object
+       * are built, and the values of all other keys are skipped.  A
+       * root value that isn't an object is skipped, leaving the
+       * document null.
+       */
+      class DocumentBuilder : public json::Handler {
+      public:
+         DocumentBuilder(const vector<string>& keys = {}) :
+            root(make_shared<pj::value>()), keys(keys) { }
+
+         json::Action start_object() override {
+            stack.push_back(&insert(pj::value(pj::object())));
+            return json::Action::CONTINUE;
+         }
+
+         json::Action end_object() override {
+            stack.pop_back();
+            return json::Action::CONTINUE;
+         }
+
+         json::Action start_array() override {
+            if (stack.empty()) {
+               return json::Action::SKIP;
+            }
+            stack.push_back(&insert(pj::value(pj::array())));
+            return json::Action::CONTINUE;
+         }
+
+         json::Action end_array() override {
+            stack.pop_back();
+            return json::Action::CONTINUE;
+         }
+
+         json::Action key(const json::StringRef& name) override {
+            if (stack.size() == 1 && ! keys.empty() &&
+                find(keys.begin(), keys.end(), name) == keys.end()) {
+               return json::Action::SKIP;
+            }
+            pending_key.assign(name.data, name.size);
+            return json::Action::CONTINUE;
+         }
+
+         json::Action null_value() override {
+            insert(pj::value());
+            return json::Action::CONTINUE;
+         }
+
+         json::Action bool_value(bool value) override {
+            insert(pj::value(value));
+            return json::Action::CONTINUE;
+         }
+
+         json::Action number_value(double value) override {
+            insert(pj::value(value));
+            return json::Action::CONTINUE;
+         }
+
+         json::Action string_value(const json::StringRef& value) override {
+            insert(pj::value(value.data, value.size));
+            return json::Action::CONTINUE;
+         }
+
+         shared_ptr<pj::value> get_document() const {
+            return root;
+         }
+
+      private:
+         pj::value& insert(pj::value&& value) {
+            if (stack.empty()) {
+               if (value.is<pj::object>()) {
+                  *root = move(value);
+               }
+               return *root;
+            }
+
+            pj::value& parent = *stack.back();
+            if (parent.is<pj::array>()) {
+               pj::array& array = parent.get<pj::array>();
+               array.push_back(move(value));
+               return array.back();
+            }
+
+            pj::value& slot = parent.get<pj::object>()[pending_key];
+            slot = move(value);
+            return slot;
+         }
+
+         shared_ptr<pj::value> root;
+         vector<string> keys;
+         vector<pj::value*> stack;
+         string pending_key;
+      };
    }
 
+   /**
+    * A precompiled path to a value nested within a settings object.
+    *
+    * Paths are written either in dotted form, e.g. "a.b[3].c", where
+    * '.' separates object keys, [n] indexes arrays, and a backslash
+    * escapes a literal '.', '[' or backslash in a key, or as RFC 6901
+    * JSON Pointers, e.g. "/a/b/3/c".  The path is parsed once into
+    * steps holding ready-made keys and indices, so resolving it against
+    * any number of documents makes no allocations.  A SettingsPath is
+    * immutable and may be shared between threads.
+    */
+   class SettingsPath {
+   public:
+      /**
+       * How a step applies: KEY to objects, INDEX to arrays, and
+       * KEY_OR_INDEX, for JSON Pointer tokens which are valid indices,
+       * to either.
+       */
+      enum class StepType {
+         KEY,
+         INDEX,
+         KEY_OR_INDEX
+      };
+
+      struct Step {
+         StepType type;
+         string key;
+         size_t index;
+      };
+
+      SettingsPath() { }
+
+      /**
+       * Parse a path in dotted form.  The empty path refers to the
+       * settings object itself.
+       */
+      explicit SettingsPath(const string& path) : text(path) {
+         size_t x = 0;
+         while (x < path.size()) {
+            if (path[x] == '[') {
+               size_t close = path.find(']', x), index = 0;
+               if (close == string::npos || ! parse_index(path.substr(x + 1, close - x - 1), index)) {
+                  throw_invalid("Expected an array index in brackets.");
+               }
+               steps.push_back({StepType::INDEX, "", index});
+               x = close + 1;
+
+            } else {
+               string key;
+               for (; x < path.size() && path[x] != '.' && path[x] != '['; x++) {
+                  if (path[x] == '\\' && ++x == path.size()) {
+                     throw_invalid("Trailing escape character.");
+                  }
+                  key.push_back(path[x]);
+               }
+               if (key.empty()) {
+                  throw_invalid("Empty key.");
+               }
+               steps.push_back({StepType::KEY, key, 0});
+            }
+
+            if (x < path.size() && path[x] == '.') {
+               if (++x == path.size()) {
+                  throw_invalid("Empty key.");
+               }
+            } else if (x < path.size() && path[x] != '[') {
+               throw_invalid("Expected '.' or '[' after an array index.");
+            }
+         }
+      }
+
+      /**
+       * Parse an RFC 6901 JSON Pointer, which is either empty, referring
+       * to the settings object itself, or a sequence of '/' prefixed
+       * tokens in which "~1" stands for '/' and "~0" for '~'.
+       */
+      static SettingsPath pointer(const string& pointer) {
+         SettingsPath path;
+         path.text = pointer;
+         if (pointer.empty()) {
+            return path;
+         }
+
+         if (pointer[0] != '/') {
+            path.throw_invalid("JSON Pointers must start with '/'.");
+         }
+
+         string token;
+         for (size_t x = 1; x <= pointer.size(); x++) {
+            if (x == pointer.size() || pointer[x] == '/') {
+               size_t index = 0;
+               path.steps.push_back({parse_index(token, index) ? StepType::KEY_OR_INDEX : StepType::KEY,
+                                     token, index});
+               token.clear();
+
+            } else if (pointer[x] == '~') {
+               if (x + 1 < pointer.size() && (pointer[x + 1] == '0' || pointer[x + 1] == '1')) {
+                  token.push_back(pointer[++x] == '0' ? '~' : '/');
+               } else {
+                  path.throw_invalid("'~' must be followed by '0' or '1'.");
+               }
+
+            } else {
+               token.push_back(pointer[x]);
+            }
+         }
+
+         return path;
+      }
+
+      const vector<Step>& get_steps() const {
+         return steps;
+      }
+
+      /**
+       * The path as it was written.
+       */
+      const string& to_string() const {
+         return text;
+      }
+
+      /**
+       * Find the value this path refers to within value, or nullptr if
+       * there is none.  V is pj::value or const pj::value.
+       */
+      template <class V>
+      V* resolve(V& value) const {
+         V* current = &value;
+
+         for (const Step& step : steps) {
+            if (current->template is<pj::object>() && step.type != StepType::INDEX) {
+               auto& obj = current->template get<pj::object>();
+               auto iter = obj.find(step.key);
+               if (iter == obj.end()) {
+                  return nullptr;
+               }
+               current = &iter->second;
+
+            } else if (current->template is<pj::array>() && step.type != StepType::KEY) {
+               auto& array = current->template get<pj::array>();
+               if (step.index >= array.size()) {
+                  return nullptr;
+               }
+               current = &array[step.index];
+
+            } else {
+               return nullptr;
+            }
+         }
+
+         return current;
+      }
+
+      friend ostream& operator<<(ostream& out, const SettingsPath& path) {
+         out << path.text;
+         return out;
+      }
+
+   private:
+      /**
+       * Parse an array index: "0", or digits without a leading zero.
+       */
+      static bool parse_index(const string& token, size_t& index) {
+         if (token.empty() || token.size() > 18 || (token[0] == '0' && token.size() > 1)) {
+            return false;
+         }
+
+         index = 0;
+         for (char c : token) {
+            if (c < '0' || c > '9') {
+               return false;
+            }
+            index = index * 10 + (c - '0');
+         }
+         return true;
+      }
+
+      [[noreturn]] void throw_invalid(const string& message) const {
+         throw SettingsException(tfm::format("Invalid settings path '%s': %s", text, message));
+      }
+
+      string text;
+      vector<Step> steps;
+   };
+
    /**
     * A wrapper class around picojson with a simplified, object-focused interface.
     *
@@ -173,6 +553,14 @@ namespace lain {
     * data types.  This allows us to fetch lists directly into C++ data types.
     * Attempting to load data that does not fit this limitation will result in
     * SettingsException being thrown.
+    *
+    * Copies of a Settings object share storage, so writes through one
+    * are seen by all of them.  The child objects returned by
+    * get_object(), get_object_array() and at_path() are views into
+    * their parent's storage, so they are made in constant time.  A view
+    * copies its own subtree on its first write, so modifying a child
+    * never changes its parent.  Replacing a value in the parent
+    * invalidates any views into it, as for iterators into a container.
     */
    class Settings {
    public:
@@ -182,17 +570,23 @@ namespace lain {
 
       virtual ~Settings() { }
 
-      static Settings load_from_file(const string& filename) {
-         shared_ptr<pj::value> obj_value = make_shared<pj::value>();
-         ifstream infile = file::open_r(filename);
-         infile >> (*obj_value);
-
-         if (! obj_value->is<pj::object>()) {
-            throw SettingsException(
-               tfm::format("Settings file does not contain an object: '%s'", filename));
-         }
+      /**
+       * Load settings from a JSON file, which is memory mapped and
+       * parsed in a single pass.  If keys is not empty, only those
+       * top-level keys are loaded, and the values of all other keys
+       * are skipped over without being decoded.
+       */
+      static Settings load_from_file(const string& filename, const vector<string>& keys = {}) {
+         file::MappedFile mapped(filename);
+         return load(mapped.data(), mapped.size(), keys,
+                     tfm::format("Settings file '%s'", filename));
+      }
 
-         return Settings(obj_value);
+      /**
+       * Load settings from a string of JSON, as for load_from_file().
+       */
+      static Settings load_from_string(const string& json, const vector<string>& keys = {}) {
+         return load(json.data(), json.size(), keys, "Settings string");
       }
 
       void save_to_file(const string& filename, bool prettify = false) const {
@@ -216,6 +610,13 @@ namespace lain {
          return lain::maps::keys(obj_value->get<pj::object>());
       }
 
+      /**
+       * The underlying picojson object, for read-only access.
+       */
+      const pj::value& get_json() const {
+         return *obj_value;
+      }
+
       template <class T>
       T get(const string& name) const {
          return json_impl::get_value<T>(*const_pointer_cast<const pj::value>(obj_value), name);
@@ -223,7 +624,13 @@ namespace lain {
 
       template <class T>
       T get(const string& name, const T& default_value) {
-         return json_impl::get_value<T>(*obj_value, name, default_value);
+         T value;
+         if (try_get<T>(name, value)) {
+            return value;
+         }
+
+         set<T>(name, default_value);
+         return default_value;
       }
 
       template <class T>
@@ -231,9 +638,29 @@ namespace lain {
          return json_impl::get_value_or_default(*const_pointer_cast<const pj::value>(obj_value), name, default_value);
       }
 
+      /**
+       * Look up name without throwing.  If it is present and of type T,
+       * assign it to value and return true.  Otherwise, return false
+       * and leave value unchanged.
+       */
+      template <class T>
+      bool try_get(const string& name, T& value) const {
+         return json_impl::try_get_value<T>(*obj_value, name, value) ==
+            json_impl::LookupStatus::FOUND;
+      }
+
+      /**
+       * Look up an array of T without throwing, as for try_get().
+       */
+      template <class T>
+      bool try_get_array(const string& name, vector<T>& vec) const {
+         return json_impl::try_get_array<T>(*obj_value, name, vec) ==
+            json_impl::LookupStatus::FOUND;
+      }
+
       template <class T>
       void set(const string& name, const T& value) {
-         json_impl::set_value<T>(*obj_value, name, value);
+         json_impl::set_value<T>(mutable_value(), name, value);
       }
 
       template <class T>
@@ -243,48 +670,129 @@ namespace lain {
 
       template <class T>
       vector<T> get_array(const string& name, const vector<T>& default_vec) {
-         return json_impl::get_array<T>(*obj_value, name, default_vec);
+         vector<T> vec;
+         if (try_get_array<T>(name, vec)) {
+            return vec;
+         }
+
+         set_array<T>(name, default_vec);
+         return default_vec;
       }
 
       template <class T>
       void set_array(const string& name, const vector<T>& vec) {
-         json_impl::set_array<T>(*obj_value, name, vec);
+         json_impl::set_array<T>(mutable_value(), name, vec);
       }
 
-      vector<Settings> get_object_array(const string& name) const {
-         pj::value obj_values_array_value = obj_value->get(name);
+      /**
+       * Get a view of the object at the given path, as for
+       * get_object().  Throws SettingsException if there is no object
+       * at the path.
+       */
+      Settings at_path(const SettingsPath& path) const {
+         pj::value* value = path.resolve(*obj_value);
+         if (value == nullptr || ! value->is<pj::object>()) {
+            throw SettingsException(tfm::format("No object at path '%s'.", path));
+         }
+         return view(*value);
+      }
+
+      /**
+       * Get a view of the object at a path in dotted form, e.g.
+       * "a.b[3].c".  Prefer a SettingsPath for paths used repeatedly.
+       */
+      Settings at_path(const string& path) const {
+         return at_path(SettingsPath(path));
+      }
+
+      /**
+       * Get a view of the object at an RFC 6901 JSON Pointer.
+       */
+      Settings at_pointer(const string& pointer) const {
+         return at_path(SettingsPath::pointer(pointer));
+      }
+
+      bool contains(const SettingsPath& path) const {
+         return path.resolve(*obj_value) != nullptr;
+      }
+
+      template <class T>
+      T get(const SettingsPath& path) const {
+         const pj::value* value = path.resolve(*const_pointer_cast<const pj::value>(obj_value));
+         if (value == nullptr) {
+            throw SettingsException(tfm::format("Missing value for path '%s'.", path));
+         }
+
+         T result;
+         if (! json_impl::try_convert<T>(*value, result)) {
+            throw SettingsException(tfm::format("Unexpected value type for path '%s'.", path));
+         }
+         return result;
+      }
 
-         if (! obj_values_array_value.is<pj::array>()) {
+      template <class T>
+      T get_default(const SettingsPath& path, const T& default_value) const {
+         T result;
+         if (try_get<T>(path, result)) {
+            return result;
+         }
+         return default_value;
+      }
+
+      template <class T>
+      bool try_get(const SettingsPath& path, T& value) const {
+         const pj::value* result = path.resolve(*const_pointer_cast<const pj::value>(obj_value));
+         return result != nullptr && json_impl::try_convert<T>(*result, value);
+      }
+
+      /**
+       * Get views of the objects in an object array, which share this
+       * object's storage until they are modified.
+       */
+      vector<Settings> get_object_array(const string& name) const {
+         pj::object& obj = obj_value->get<pj::object>();
+         auto iter = obj.find(name);
+         if (iter == obj.end() || ! iter->second.is<pj::array>()) {
             throw SettingsException(tfm::format("Key '%s' does not refer to an object array.", name));
          }
 
-         pj::array& obj_values_array = obj_values_array_value.get<pj::array>();
+         pj::array& obj_values_array = iter->second.get<pj::array>();
          vector<Settings> obj_array;
+         obj_array.reserve(obj_values_array.size());
 
-         for (pj::value val : obj_values_array) {
+         for (pj::value& val : obj_values_array) {
             if (! val.is<pj::object>()) {
                throw SettingsException(tfm::format("Object array contains non-object: '%s'", name));
             }
 
-            obj_array.push_back(Settings(make_shared<pj::value>(val)));
+            obj_array.push_back(view(val));
          }
 
          return obj_array;
       }
 
       void set_object_array(const string& name, const vector<Settings>& obj_list) {
-         pj::array array;
-         pj::object& obj = obj_value->get<pj::object>();
-
-         for (Settings obj : obj_list) {
-            array.push_back(*(obj.obj_value.get()));
+         // Build the array before taking the slot, in case obj_list
+         // contains views of it.
+         pj::value value = pj::value(pj::array());
+         pj::array& array = value.get<pj::array>();
+         array.reserve(obj_list.size());
+
+         for (const Settings& obj : obj_list) {
+            array.push_back(*obj.obj_value);
          }
 
-         obj[name] = pj::value(array);
+         mutable_value().get<pj::object>()[name].swap(value);
       }
 
+      /**
+       * Get a view of the object with the given name, which shares
+       * this object's storage until it is modified.
+       */
       Settings get_object(const string& name, bool must_exist = false) const {
-         if (! obj_value->contains(name)) {
+         pj::object& obj = obj_value->get<pj::object>();
+         auto iter = obj.find(name);
+         if (iter == obj.end()) {
             if (must_exist) {
                throw SettingsException(tfm::format("Missing object for key '%s'.", name));
 
@@ -293,17 +801,17 @@ namespace lain {
             }
          }
 
-         pj::value object_json = obj_value->get(name);
-         if (! object_json.is<pj::object>()) {
+         if (! iter->second.is<pj::object>()) {
             throw SettingsException(tfm::format("Key '%s' does not refer to a object.", name));
          }
 
-         return Settings(make_shared<pj::value>(object_json));
+         return view(iter->second);
       }
 
       void set_object(const string& name, const Settings& object) {
-         pj::object& obj = obj_value->get<pj::object>();
-         obj[name] = (*object.obj_value);
+         // Copy before taking the slot, in case object is a view of it.
+         pj::value value = *object.obj_value;
+         mutable_value().get<pj::object>()[name].swap(value);
       }
 
       friend ostream& operator<<(ostream& out, const Settings& settings) {
@@ -312,7 +820,50 @@ namespace lain {
       }
 
    private:
+      /**
+       * A Settings object for a value within this object's storage,
+       * which shares ownership of the storage without copying it.
+       */
+      Settings view(pj::value& value) const {
+         Settings child(shared_ptr<pj::value>(obj_value, &value));
+         child.is_view = true;
+         return child;
+      }
+
+      /**
+       * The value to modify, first giving a view a private copy of its
+       * subtree so that the write isn't seen by its parent.
+       */
+      pj::value& mutable_value() {
+         if (is_view) {
+            obj_value = make_shared<pj::value>(*obj_value);
+            is_view = false;
+         }
+         return *obj_value;
+      }
+
+      static Settings load(const char* data, size_t size, const vector<string>& keys,
+                           const string& source) {
+         json_impl::DocumentBuilder builder(keys);
+
+         try {
+            json::parse(data, size, builder);
+
+         } catch (const json::JsonException& e) {
+            throw SettingsException(tfm::format("%s is not valid JSON: %s",
+                                                source, e.get_message()));
+         }
+
+         shared_ptr<pj::value> obj_value = builder.get_document();
+         if (! obj_value->is<pj::object>()) {
+            throw SettingsException(tfm::format("%s does not contain an object.", source));
+         }
+
+         return Settings(obj_value);
+      }
+
       shared_ptr<pj::value> obj_value;
+      bool is_view = false;
    };
 
    namespace json_impl {
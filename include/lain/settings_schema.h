@@ -0,0 +1,330 @@
+/*
+ * settings_schema.h: Typed binding between Settings and plain C++
+ *    structs, driven by a compile-time field list.
+ *
+ * A struct is bound by declaring, in its own namespace, a function
+ * returning its fields, which is found by argument dependent lookup:
+ *
+ *    struct Graphics {
+ *       int width;
+ *       int height;
+ *       bool fullscreen = false;
+ *    };
+ *
+ *    inline auto settings_schema(const Graphics*) {
+ *       return lain::schema::fields(
+ *          LAIN_FIELD(Graphics, width),
+ *          LAIN_FIELD(Graphics, height),
+ *          LAIN_OPTIONAL_FIELD(Graphics, fullscreen));
+ *    }
+ *
+ *    Graphics graphics = lain::schema::from_settings<Graphics>(settings);
+ *
+ * Fields may be bool, int, float, double, string, structs with their
+ * own schema, or vectors of any of these.  Any other field type fails
+ * to compile.  Optional fields keep their initial value when absent.
+ *
+ * Author: Lain Supe (lainproliant)
+ */
+#ifndef __LAIN_SETTINGS_SCHEMA_H
+#define __LAIN_SETTINGS_SCHEMA_H
+
+#include <climits>
+#include <cmath>
+#include <string>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "lain/settings.h"
+#include "lain/string.h"
+
+#define LAIN_FIELD(type, member) lain::schema::field(#member, &type::member)
+#define LAIN_OPTIONAL_FIELD(type, member) lain::schema::optional(#member, &type::member)
+
+namespace lain {
+   using namespace std;
+
+   /**
+    * Thrown when settings don't match a schema, listing every mismatch
+    * rather than only the first.
+    */
+   class SchemaException : public SettingsException {
+   public:
+      SchemaException(const vector<string>& errors) :
+         SettingsException(tfm::format("Settings do not match the schema:\n    %s",
+                                       str::join(errors, "\n    "))),
+         errors(errors) { }
+
+      const vector<string>& get_errors() const {
+         return errors;
+      }
+
+   private:
+      vector<string> errors;
+   };
+
+   namespace schema {
+      template <class C, class M>
+      struct Field {
+         const char* name;
+         M C::* member;
+         bool required;
+      };
+
+      /**
+       * A field which must be present.
+       */
+      template <class C, class M>
+      Field<C, M> field(const char* name, M C::* member) {
+         return {name, member, true};
+      }
+
+      /**
+       * A field which keeps its initial value when it isn't present.
+       */
+      template <class C, class M>
+      Field<C, M> optional(const char* name, M C::* member) {
+         return {name, member, false};
+      }
+
+      template <class... F>
+      tuple<F...> fields(F... f) {
+         return tuple<F...>(f...);
+      }
+
+      namespace impl {
+         /**
+          * A node in the path to the value being read, which is only
+          * formatted when there is an error to report.
+          */
+         struct Path {
+            const Path* parent;
+            const char* key;
+            size_t index;
+
+            string to_string() const {
+               string prefix = parent != nullptr ? parent->to_string() : "";
+               if (key == nullptr) {
+                  return tfm::format("%s[%d]", prefix, index);
+               }
+               return prefix.empty() ? string(key) : prefix + "." + key;
+            }
+         };
+
+         inline void error(vector<string>& errors, const Path* path, const char* message) {
+            errors.push_back(tfm::format("%s: %s", path != nullptr ? path->to_string() : "(root)", message));
+         }
+
+         template <class T>
+         struct has_schema {
+            template <class U>
+            static auto check(int) -> decltype(settings_schema((const U*)nullptr), true_type());
+
+            template <class U>
+            static false_type check(...);
+
+            static const bool value = decltype(check<T>(0))::value;
+         };
+
+         template <class Tuple, class F, size_t... I>
+         void for_each(const Tuple& tuple, F&& f, index_sequence<I...>) {
+            int expand[] = {0, (f(get<I>(tuple)), 0)...};
+            (void)expand;
+         }
+
+         template <class... Fs, class F>
+         void for_each(const tuple<Fs...>& tuple, F&& f) {
+            for_each(tuple, forward<F>(f), index_sequence_for<Fs...>());
+         }
+
+         /**
+          * Reads and writes values of type T, selected at compile time.
+          */
+         template <class T, class Enable = void>
+         struct Codec {
+            static_assert(sizeof(T) == 0,
+                          "Settings schema fields must be bool, int, float, double, string, "
+                          "a struct with a settings_schema(), or a vector of these.");
+         };
+
+         template <>
+         struct Codec<bool> {
+            static void read(const pj::value& value, bool& out, const Path* path, vector<string>& errors) {
+               if (! value.is<bool>()) {
+                  error(errors, path, "Expected a boolean.");
+                  return;
+               }
+               out = value.get<bool>();
+            }
+
+            static void write(bool in, pj::value& out) {
+               pj::value(in).swap(out);
+            }
+         };
+
+         template <>
+         struct Codec<int> {
+            static void read(const pj::value& value, int& out, const Path* path, vector<string>& errors) {
+               if (! value.is<double>()) {
+                  error(errors, path, "Expected an integer.");
+                  return;
+               }
+
+               double number = value.get<double>();
+               if (! (number >= INT_MIN && number <= INT_MAX) || number != floor(number)) {
+                  error(errors, path, "Expected an integer.");
+                  return;
+               }
+               out = (int)number;
+            }
+
+            static void write(int in, pj::value& out) {
+               pj::value((double)in).swap(out);
+            }
+         };
+
+         template <class T>
+         struct Codec<T, typename enable_if<is_floating_point<T>::value>::type> {
+            static void read(const pj::value& value, T& out, const Path* path, vector<string>& errors) {
+               if (! value.is<double>()) {
+                  error(errors, path, "Expected a number.");
+                  return;
+               }
+               out = (T)value.get<double>();
+            }
+
+            static void write(T in, pj::value& out) {
+               pj::value((double)in).swap(out);
+            }
+         };
+
+         template <>
+         struct Codec<string> {
+            static void read(const pj::value& value, string& out, const Path* path, vector<string>& errors) {
+               if (! value.is<string>()) {
+                  error(errors, path, "Expected a string.");
+                  return;
+               }
+               out = value.get<string>();
+            }
+
+            static void write(const string& in, pj::value& out) {
+               pj::value(in).swap(out);
+            }
+         };
+
+         template <class T>
+         struct Codec<vector<T>> {
+            static void read(const pj::value& value, vector<T>& out, const Path* path, vector<string>& errors) {
+               if (! value.is<pj::array>()) {
+                  error(errors, path, "Expected an array.");
+                  return;
+               }
+
+               // Elements are read into a local, since the elements of a
+               // vector<bool> can't be bound to a bool&.
+               const pj::array& array = value.get<pj::array>();
+               out.resize(array.size());
+               for (size_t x = 0; x < array.size(); x++) {
+                  Path element = {path, nullptr, x};
+                  T item(move(out[x]));
+                  Codec<T>::read(array[x], item, &element, errors);
+                  out[x] = move(item);
+               }
+            }
+
+            static void write(const vector<T>& in, pj::value& out) {
+               pj::value(pj::array()).swap(out);
+               pj::array& array = out.get<pj::array>();
+               array.resize(in.size());
+               for (size_t x = 0; x < in.size(); x++) {
+                  Codec<T>::write(in[x], array[x]);
+               }
+            }
+         };
+
+         template <class T>
+         struct Codec<T, typename enable_if<has_schema<T>::value>::type> {
+            static void read(const pj::value& value, T& out, const Path* path, vector<string>& errors) {
+               if (! value.is<pj::object>()) {
+                  error(errors, path, "Expected an object.");
+                  return;
+               }
+
+               const pj::object& obj = value.get<pj::object>();
+               for_each(settings_schema((const T*)nullptr), [&](const auto& field) {
+                  typedef typename remove_reference<decltype(out.*field.member)>::type M;
+                  Path member = {path, field.name, 0};
+
+                  auto iter = obj.find(field.name);
+                  if (iter == obj.end()) {
+                     if (field.required) {
+                        error(errors, &member, "Missing required value.");
+                     }
+                     return;
+                  }
+
+                  Codec<M>::read(iter->second, out.*field.member, &member, errors);
+               });
+            }
+
+            static void write(const T& in, pj::value& out) {
+               pj::value(pj::object()).swap(out);
+               pj::object& obj = out.get<pj::object>();
+               for_each(settings_schema((const T*)nullptr), [&](const auto& field) {
+                  typedef typename remove_const<typename remove_reference<
+                     decltype(in.*field.member)>::type>::type M;
+                  Codec<M>::write(in.*field.member, obj[field.name]);
+               });
+            }
+         };
+      }
+
+      /**
+       * Read settings into out, appending a message to errors for each
+       * field which is missing or has the wrong type, and returning
+       * whether there were none.  Fields which could be read are
+       * assigned even if others could not.
+       */
+      template <class T>
+      bool read(const Settings& settings, T& out, vector<string>& errors) {
+         static_assert(impl::has_schema<T>::value,
+                       "No settings_schema() is declared for this type.");
+
+         size_t num_errors = errors.size();
+         impl::Codec<T>::read(settings.get_json(), out, nullptr, errors);
+         return errors.size() == num_errors;
+      }
+
+      /**
+       * Read settings into a new T, throwing SchemaException with every
+       * mismatch if they don't match its schema.
+       */
+      template <class T>
+      T from_settings(const Settings& settings) {
+         T out;
+         vector<string> errors;
+         if (! read(settings, out, errors)) {
+            throw SchemaException(errors);
+         }
+         return out;
+      }
+
+      /**
+       * Write every field of value into a new Settings object.
+       */
+      template <class T>
+      Settings to_settings(const T& value) {
+         static_assert(impl::has_schema<T>::value,
+                       "No settings_schema() is declared for this type.");
+
+         shared_ptr<pj::value> obj_value = make_shared<pj::value>();
+         impl::Codec<T>::write(value, *obj_value);
+         return Settings(obj_value);
+      }
+   }
+}
+
+#endif
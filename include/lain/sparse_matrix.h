@@ -0,0 +1,239 @@
+/*
+ * sparse_matrix.h: A chunked matrix which allocates storage lazily,
+ *    for grids which are mostly a single default value.
+ *
+ * Author: Lain Supe (lainproliant)
+ */
+#ifndef __LAIN_SPARSE_MATRIX_H
+#define __LAIN_SPARSE_MATRIX_H
+
+#include <algorithm>
+#include <cassert>
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+namespace lain {
+   using namespace std;
+
+   /**
+    * A matrix divided into CW x CH chunks, each of which is allocated
+    * only when one of its cells is first written.  Reading from an
+    * unallocated chunk returns the default value without allocating.
+    *
+    * The non-const at() always allocates the chunk containing (x, y),
+    * since it returns a mutable reference.  Prefer get() and set() when
+    * accesses are likely to be to default cells: set() of the default
+    * value to an unallocated chunk is a no-op.
+    *
+    * scan() visits only the cells of allocated chunks.
+    */
+   template<class T, int CW = 64, int CH = 64>
+   class SparseMatrix {
+   public:
+      static const int chunk_width = CW;
+      static const int chunk_height = CH;
+
+      SparseMatrix(int width_in, int height_in, const T& default_val = T()) :
+         _width(width_in), _height(height_in),
+         chunks_across((width_in + CW - 1) / CW),
+         default_val(default_val),
+         chunks((size_t)chunks_across * ((height_in + CH - 1) / CH)) { }
+
+      SparseMatrix(const SparseMatrix<T, CW, CH>& rhs) :
+         _width(rhs._width), _height(rhs._height),
+         chunks_across(rhs.chunks_across), default_val(rhs.default_val),
+         chunks(rhs.chunks.size()) {
+         for (size_t x = 0; x < chunks.size(); x++) {
+            if (rhs.chunks[x]) {
+               chunks[x].reset(new T[CW * CH]);
+               copy(rhs.chunks[x].get(), rhs.chunks[x].get() + CW * CH, chunks[x].get());
+            }
+         }
+      }
+
+      SparseMatrix(SparseMatrix<T, CW, CH>&& rhs) = default;
+
+      SparseMatrix<T, CW, CH>& operator=(const SparseMatrix<T, CW, CH>& rhs) {
+         if (this != &rhs) {
+            *this = SparseMatrix<T, CW, CH>(rhs);
+         }
+         return *this;
+      }
+
+      SparseMatrix<T, CW, CH>& operator=(SparseMatrix<T, CW, CH>&& rhs) = default;
+
+      virtual ~SparseMatrix() { }
+
+      /**
+       * Get a mutable reference to the element at (x, y), allocating
+       * its chunk if it has not yet been allocated.
+       */
+      T& at(int x, int y) {
+         assert(x < _width && y < _height);
+         unique_ptr<T[]>& chunk = chunks[chunk_index(x, y)];
+         if (! chunk) {
+            allocate(chunk);
+         }
+         return chunk[cell_index(x, y)];
+      }
+
+      /**
+       * Get a const reference to the element at (x, y).
+       */
+      const T& at(int x, int y) const {
+         return get(x, y);
+      }
+
+      /**
+       * Get the element at (x, y), or the default value if its
+       * chunk has not been allocated.
+       */
+      const T& get(int x, int y) const {
+         assert(x < _width && y < _height);
+         const unique_ptr<T[]>& chunk = chunks[chunk_index(x, y)];
+         return chunk ? chunk[cell_index(x, y)] : default_val;
+      }
+
+      /**
+       * Set the element at (x, y).  Setting a cell in an unallocated
+       * chunk to the default value does not allocate the chunk.
+       */
+      void set(int x, int y, const T& val) {
+         assert(x < _width && y < _height);
+         unique_ptr<T[]>& chunk = chunks[chunk_index(x, y)];
+         if (! chunk) {
+            if (val == default_val) {
+               return;
+            }
+            allocate(chunk);
+         }
+         chunk[cell_index(x, y)] = val;
+      }
+
+      /**
+       * Call f(x, y, cell) for each cell in an allocated chunk, one
+       * chunk at a time, stopping early if f returns false.
+       */
+      template<class F>
+      void scan(F f) {
+         scan_chunks(*this, f);
+      }
+
+      template<class F>
+      void scan(F f) const {
+         scan_chunks(*this, f);
+      }
+
+      /**
+       * Release every chunk, resetting all cells to the default value.
+       */
+      void clear() {
+         for (unique_ptr<T[]>& chunk : chunks) {
+            chunk.reset();
+         }
+      }
+
+      /**
+       * Release every chunk in which all cells hold the default value.
+       *
+       * @return The number of chunks released.
+       */
+      size_t prune() {
+         size_t released = 0;
+
+         for (unique_ptr<T[]>& chunk : chunks) {
+            if (chunk && all_of(chunk.get(), chunk.get() + CW * CH,
+                                [&](const T& val) { return val == default_val; })) {
+               chunk.reset();
+               released++;
+            }
+         }
+
+         return released;
+      }
+
+      /**
+       * The number of chunks which have been allocated.
+       */
+      size_t populated_chunks() const {
+         return count_if(chunks.begin(), chunks.end(),
+                         [](const unique_ptr<T[]>& chunk) { return chunk != nullptr; });
+      }
+
+      /**
+       * The approximate number of bytes used by this matrix, including
+       * the chunk directory and all allocated chunks.
+       */
+      size_t memory_usage() const {
+         return sizeof(*this)
+            + chunks.capacity() * sizeof(unique_ptr<T[]>)
+            + populated_chunks() * CW * CH * sizeof(T);
+      }
+
+      /**
+       * The approximate number of bytes a dense Matrix<T> of the same
+       * dimensions would use, for comparison with memory_usage().
+       */
+      size_t dense_memory_usage() const {
+         return (size_t)_width * _height * sizeof(T);
+      }
+
+      int width() const {
+         return _width;
+      }
+
+      int height() const {
+         return _height;
+      }
+
+      int size() const {
+         return _width * _height;
+      }
+
+   private:
+      size_t chunk_index(int x, int y) const {
+         return (size_t)(y / CH) * chunks_across + x / CW;
+      }
+
+      static size_t cell_index(int x, int y) {
+         return (y % CH) * CW + x % CW;
+      }
+
+      void allocate(unique_ptr<T[]>& chunk) {
+         chunk.reset(new T[CW * CH]);
+         fill(chunk.get(), chunk.get() + CW * CH, default_val);
+      }
+
+      template<class M, class F>
+      static void scan_chunks(M& m, F& f) {
+         typedef typename conditional<is_const<M>::value, const T, T>::type cell_type;
+
+         for (size_t n = 0; n < m.chunks.size(); n++) {
+            if (! m.chunks[n]) {
+               continue;
+            }
+
+            const int x0 = (n % m.chunks_across) * CW;
+            const int y0 = (n / m.chunks_across) * CH;
+            const int x1 = min(x0 + CW, m._width);
+            const int y1 = min(y0 + CH, m._height);
+
+            for (int y = y0; y < y1; y++) {
+               for (int x = x0; x < x1; x++) {
+                  cell_type& cell = m.chunks[n][cell_index(x, y)];
+                  if (! f(x, y, cell)) {
+                     return;
+                  }
+               }
+            }
+         }
+      }
+
+      int _width, _height, chunks_across;
+      T default_val;
+      vector<unique_ptr<T[]>> chunks;
+   };
+}
+
+#endif
@@ -2,6 +2,15 @@
  * testing.h: A very simple to use unit testing framework
  *    built around lambda expressions.
  *
+ * Define LAIN_TESTING_BENCHMARKS before including this header to
+ * register microbenchmarks with TestSuite::benchmark() and gate them
+ * on a saved baseline.  This pulls in benchmark.h and so picojson.
+ *
+ * Define LAIN_TESTING_POSIX to enable features which need a POSIX
+ * system: per-test timeouts, which run tests in forked children, the
+ * async-signal-safe crash handler for die_on_signal(), and CPU time
+ * and peak RSS in each test's resource report.
+ *
  * Author: Lain Supe (lainproliant)
  * Date: Thu October 9, 2014
  */
@@ -9,21 +18,49 @@
 #define __LAIN_TESTING_H
 
 #include <iostream>
+#include <fstream>
+#include <sstream>
 #include <algorithm>
 #include <functional>
 #include <vector>
 #include <cstdlib>
 #include <cstring>
+#include <cerrno>
+#include <cstdio>
 #include <csignal>
 #include <cfloat>
 #include <cmath>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <chrono>
+#include <ctime>
 
+#include "lain/alloc_hook.h"
 #include "lain/exception.h"
+#include "lain/thread_pool.h"
+#include "lain/timing.h"
 #include "tinyformat/tinyformat.h"
 
+#ifdef LAIN_TESTING_BENCHMARKS
+#include "lain/benchmark.h"
+#endif
+
+#ifdef LAIN_TESTING_POSIX
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "lain/crash_handler.h"
+#endif
+
 namespace lain {
    namespace testing {
       using namespace std;
+      using bench::do_not_optimize;
+      using bench::clobber_memory;
 
       class TestException : public Exception {
       public:
@@ -38,20 +75,189 @@ namespace lain {
       class UnitTest {
       public:
          UnitTest(const string& name, function<bool()> test_fn) :
-            name(name), test_fn(test_fn) {}
+            test_fn([test_fn](ostream&) { return test_fn(); }), name(name) {}
+         UnitTest(const string& name, function<bool(ostream&)> test_fn,
+                  bool exclusive = false) :
+            test_fn(test_fn), name(name), exclusive(exclusive) {}
          virtual ~UnitTest() {}
 
-         bool run() const {
-            return test_fn();
+         bool run(ostream& out = cout) const {
+            return test_fn(out);
          }
 
          string get_name() const {
             return name;
          }
 
+         /**
+          * Whether this test must not run concurrently with others,
+          * e.g. because it measures time.
+          */
+         bool is_exclusive() const {
+            return exclusive;
+         }
+
+         /**
+          * The time this test may run before it is killed, or zero to
+          * use the suite's default.  See TestSuite::timeout().
+          */
+         chrono::milliseconds get_timeout() const {
+            return timeout;
+         }
+
+         UnitTest& set_timeout(chrono::milliseconds timeout) {
+            this->timeout = timeout;
+            return *this;
+         }
+
       private:
-         function<bool()> test_fn;
+         function<bool(ostream&)> test_fn;
          string name;
+         bool exclusive = false;
+         chrono::milliseconds timeout = chrono::milliseconds(0);
+      };
+
+      /**
+       * Resources used by a single test.
+       */
+      struct TestStats {
+         double wall_ns = 0;
+         double cpu_ns = 0;
+         long peak_rss_delta_kb = 0;
+         alloc::AllocationCounts allocs = {0, 0, 0};
+
+         string to_string() const {
+            string str = tfm::format("    [%s wall", bench::format_ns(wall_ns));
+#ifdef LAIN_TESTING_POSIX
+            str += tfm::format(", %s cpu, +%dKiB peak rss",
+                               bench::format_ns(cpu_ns), peak_rss_delta_kb);
+#endif
+            if (alloc::hook_installed()) {
+               str += tfm::format(", %d allocations, %d bytes",
+                                  allocs.allocations, allocs.bytes);
+            }
+            return str + "]";
+         }
+      };
+
+#ifdef LAIN_TESTING_POSIX
+      inline long peak_rss_kb() {
+         struct rusage usage;
+         getrusage(RUSAGE_SELF, &usage);
+         return usage.ru_maxrss;
+      }
+#endif
+
+      /**
+       * Measures the wall time and allocations by the calling thread
+       * between its construction and stop(), and with
+       * LAIN_TESTING_POSIX also the CPU time of the calling thread and
+       * growth in the process' peak RSS.
+       */
+      class ResourceMeter {
+      public:
+         ResourceMeter() :
+            wall_start(chrono::steady_clock::now()), allocs_start(alloc::thread_counts()) {
+#ifdef LAIN_TESTING_POSIX
+            cpu_start = thread_cpu_ns();
+            rss_start = peak_rss_kb();
+#endif
+         }
+
+         TestStats stop() const {
+            TestStats stats;
+            stats.wall_ns = chrono::duration<double, nano>(
+               chrono::steady_clock::now() - wall_start).count();
+            stats.allocs = alloc::thread_counts() - allocs_start;
+#ifdef LAIN_TESTING_POSIX
+            stats.cpu_ns = thread_cpu_ns() - cpu_start;
+            stats.peak_rss_delta_kb = peak_rss_kb() - rss_start;
+#endif
+            return stats;
+         }
+
+      private:
+         chrono::steady_clock::time_point wall_start;
+         alloc::AllocationCounts allocs_start;
+
+#ifdef LAIN_TESTING_POSIX
+         static double thread_cpu_ns() {
+            struct timespec ts;
+            clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+            return ts.tv_sec * 1e9 + ts.tv_nsec;
+         }
+
+         double cpu_start = 0;
+         long rss_start = 0;
+#endif
+      };
+
+      /**
+       * A streambuf installed in place of a stream's own, which sends
+       * output to a buffer chosen per thread, or to the original
+       * streambuf for threads which haven't chosen one.  The original
+       * is restored on destruction.
+       */
+      class ThreadCaptureBuf : public streambuf {
+      public:
+         ThreadCaptureBuf(ostream& stream) :
+            stream(stream), fallback(stream.rdbuf(this)) { }
+
+         virtual ~ThreadCaptureBuf() {
+            stream.rdbuf(fallback);
+         }
+
+         /**
+          * The buffer the current thread's output is captured in,
+          * or nullptr if it is not being captured.
+          */
+         static streambuf*& target() {
+            static thread_local streambuf* buf = nullptr;
+            return buf;
+         }
+
+      protected:
+         int overflow(int c) override {
+            if (traits_type::eq_int_type(c, traits_type::eof())) {
+               return traits_type::not_eof(c);
+            }
+            return sink()->sputc(traits_type::to_char_type(c));
+         }
+
+         streamsize xsputn(const char* s, streamsize n) override {
+            return sink()->sputn(s, n);
+         }
+
+         int sync() override {
+            return sink()->pubsync();
+         }
+
+      private:
+         streambuf* sink() const {
+            streambuf* buf = target();
+            return buf != nullptr ? buf : fallback;
+         }
+
+         ostream& stream;
+         streambuf* fallback;
+      };
+
+      /**
+       * Capture the current thread's output in buf for the lifetime
+       * of this object.
+       */
+      class CaptureScope {
+      public:
+         CaptureScope(streambuf* buf) : prev(ThreadCaptureBuf::target()) {
+            ThreadCaptureBuf::target() = buf;
+         }
+
+         ~CaptureScope() {
+            ThreadCaptureBuf::target() = prev;
+         }
+
+      private:
+         streambuf* prev;
       };
 
       class TestSuite {
@@ -63,13 +269,107 @@ namespace lain {
             return test(UnitTest(name, test_fn));
          }
 
+#ifdef LAIN_TESTING_POSIX
+         TestSuite& test(string name, std::function<bool()> test_fn,
+                         chrono::milliseconds timeout) {
+            return test(UnitTest(name, test_fn).set_timeout(timeout));
+         }
+#endif
+
          TestSuite& test(const UnitTest& test) {
             tests.push_back(test);
             return *this;
          }
 
+#ifdef LAIN_TESTING_BENCHMARKS
+         /**
+          * Register a microbenchmark.  It is run in order with the
+          * tests, printing its timing statistics, and fails if bench_fn
+          * throws or if it has regressed relative to the baseline (see
+          * baseline()).  Pass the result of any computation to
+          * do_not_optimize() so that it isn't optimized away.
+          */
+         TestSuite& benchmark(const string& name, std::function<void()> bench_fn,
+                              const bench::Options& opts = bench::Options()) {
+            shared_ptr<BenchmarkState> state = benchmarks;
+            return test(UnitTest(name, [=](ostream& out)->bool {
+               bench::BenchmarkResult result = bench::measure(name, bench_fn, opts);
+               out << bench::format_summary(result);
+               state->results.push_back(result);
+
+               auto iter = state->baseline.find(name);
+               if (iter != state->baseline.end()) {
+                  bench::Comparison cmp = bench::compare(iter->second, result, state->policy);
+                  if (cmp.regressed) {
+                     out << "    REGRESSION: " << cmp.describe() << endl;
+                     return false;
+                  }
+                  out << "    " << cmp.describe() << endl;
+               }
+               return true;
+            }, true));
+         }
+
+         /**
+          * Compare benchmark results against the baseline saved in the
+          * given JSON file, failing those which have regressed according
+          * to policy.  If the file doesn't exist, or the environment
+          * variable LAIN_UPDATE_BASELINE is set, the results of this run
+          * are saved to it instead.
+          */
+         TestSuite& baseline(const string& filename,
+                             const bench::RegressionPolicy& policy = bench::RegressionPolicy()) {
+            benchmarks->baseline_file = filename;
+            benchmarks->policy = policy;
+            benchmarks->baseline.clear();
+
+            if (getenv("LAIN_UPDATE_BASELINE") == nullptr && ifstream(filename).good()) {
+               benchmarks->baseline = bench::load_results(filename);
+            }
+            return *this;
+         }
+#endif
+
+         /**
+          * Run tests concurrently on a pool of num_threads workers.
+          * Output each test writes to cout or cerr is captured and
+          * printed in registration order once all tests are done.
+          * Exclusive tests, such as benchmarks, are run serially
+          * afterwards.  Output written directly to stdio or by threads
+          * other than the one running a test is not captured.
+          */
+         TestSuite& parallel(unsigned int num_threads = thread::hardware_concurrency()) {
+            this->num_threads = num_threads;
+            return *this;
+         }
+
+#ifdef LAIN_TESTING_POSIX
+         /**
+          * Kill and fail any test which runs for longer than the given
+          * time.  Tests with a timeout are run in a forked child process
+          * so that they can be killed; their output is streamed back to
+          * the parent, and a crash in the child fails only that test.
+          * Benchmarks always run in-process, since their results are
+          * recorded by the suite.
+          */
+         TestSuite& timeout(chrono::milliseconds timeout) {
+            default_timeout = timeout;
+            return *this;
+         }
+#endif
+
+         /**
+          * Report the given signal and terminate if it is raised.  With
+          * LAIN_TESTING_POSIX, the async-signal-safe handler in
+          * crash_handler.h reports a stack trace, which can be resolved
+          * with crash::symbolize_report().
+          */
          TestSuite& die_on_signal(int signalId) {
+#ifdef LAIN_TESTING_POSIX
+            crash::install(signalId);
+#else
             signal(signalId, signal_callback);
+#endif
             return *this;
          }
 
@@ -78,36 +378,26 @@ namespace lain {
 
             out << "===== " << name << " =====" << endl;
 
-            for (const UnitTest& test : tests) {
-               try {
-                  out << "Running test: '"
-                      << test.get_name()
-                      << "'..." << endl;
-
-                  if (test.run()) {
-                     out << "    PASSED" << endl;
-
-                  } else {
-                     out << "    FAILED" << endl;
-                     tests_failed ++;
-                  }
-
-               } catch (...) {
-                  std::exception_ptr eptr = std::current_exception();
-
-                  try {
-                     std::rethrow_exception(eptr);
-                  } catch (const std::exception& e) {
-                     out << "    FAILED (" << typeid(e).name() << "): " << e.what() << endl;
-#ifdef LAIN_ENABLE_STACKTRACE
-                     out << tfm::format("%s\n", format_stacktrace(generate_stacktrace()));
+#ifdef LAIN_TESTING_BENCHMARKS
+            benchmarks->results.clear();
 #endif
-                  }
 
-                  tests_failed ++;
+            if (num_threads > 0) {
+               tests_failed = run_parallel(out);
+
+            } else {
+               for (const UnitTest& test : tests) {
+                  tests_failed += run_test(test, out);
                }
             }
 
+#ifdef LAIN_TESTING_BENCHMARKS
+            if (benchmarks->baseline_file != "" && benchmarks->baseline.empty()) {
+               bench::save_results(benchmarks->baseline_file, name, benchmarks->results);
+               out << "Saved benchmark baseline: '" << benchmarks->baseline_file << "'" << endl;
+            }
+#endif
+
             out << endl;
 
             return tests_failed;
@@ -117,7 +407,311 @@ namespace lain {
             return tests.size();
          }
 
+#ifdef LAIN_TESTING_BENCHMARKS
+         /**
+          * The results of the benchmarks run by the last call to run().
+          */
+         const vector<bench::BenchmarkResult>& benchmark_results() const {
+            return benchmarks->results;
+         }
+#endif
+
       private:
+#ifdef LAIN_TESTING_BENCHMARKS
+         /**
+          * Shared with the benchmark tests, which outlive any copy of
+          * the suite they were registered with.
+          */
+         struct BenchmarkState {
+            string baseline_file;
+            map<string, bench::BenchmarkResult> baseline;
+            bench::RegressionPolicy policy;
+            vector<bench::BenchmarkResult> results;
+         };
+#endif
+
+         /**
+          * The result of running a single test.  If the test threw,
+          * error describes the exception.
+          */
+         struct Outcome {
+            bool passed = false;
+            string error;
+            TestStats stats;
+         };
+
+         int run_test(const UnitTest& test, ostream& out) const {
+            out << "Running test: '"
+                << test.get_name()
+                << "'..." << endl;
+
+#ifdef LAIN_TESTING_POSIX
+            chrono::milliseconds timeout = test.get_timeout() > chrono::milliseconds(0) ?
+               test.get_timeout() : default_timeout;
+
+            Outcome outcome = timeout > chrono::milliseconds(0) && ! test.is_exclusive() ?
+               execute_forked(test, out, timeout) : execute(test, out);
+#else
+            Outcome outcome = execute(test, out);
+#endif
+
+            if (outcome.passed) {
+               out << "    PASSED" << endl;
+            } else if (outcome.error != "") {
+               out << "    FAILED " << outcome.error << endl;
+            } else {
+               out << "    FAILED" << endl;
+            }
+            out << outcome.stats.to_string() << endl;
+
+            return outcome.passed ? 0 : 1;
+         }
+
+         static Outcome execute(const UnitTest& test, ostream& out) {
+            Outcome outcome;
+            ResourceMeter meter;
+
+            try {
+               outcome.passed = test.run(out);
+
+            } catch (...) {
+               std::exception_ptr eptr = std::current_exception();
+
+               try {
+                  std::rethrow_exception(eptr);
+               } catch (const std::exception& e) {
+                  outcome.error = tfm::format("(%s): %s", typeid(e).name(), e.what());
+#ifdef LAIN_ENABLE_STACKTRACE
+                  // Prefer the stack where a lain::Exception was thrown
+                  // to the stack here, where it was caught.
+                  const Exception* lain_e = dynamic_cast<const Exception*>(&e);
+                  outcome.error += "\n" + (lain_e != nullptr ? lain_e->format_stacktrace() :
+                                           format_stacktrace(generate_stacktrace()));
+#endif
+               }
+            }
+
+            outcome.stats = meter.stop();
+            return outcome;
+         }
+
+#ifdef LAIN_TESTING_POSIX
+         /**
+          * Sent from a forked child to the parent after the test has run,
+          * followed by error_length bytes of the outcome's error.
+          */
+         struct ChildReport {
+            int passed;
+            alloc::AllocationCounts allocs;
+            size_t error_length;
+         };
+
+         /**
+          * Held by the parent from creating a test's pipes until it has
+          * closed their write ends, so that a child forked concurrently
+          * for another test can't inherit them and delay their EOF.
+          */
+         static mutex& fork_mutex() {
+            static mutex m;
+            return m;
+         }
+
+         static void open_pipe(int fds[2]) {
+            if (pipe(fds) != 0) {
+               throw TestException(tfm::format("Failed to create pipe: %s", strerror(errno)));
+            }
+            fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+            fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+         }
+
+         Outcome execute_forked(const UnitTest& test, ostream& out,
+                                chrono::milliseconds timeout) const {
+            int out_pipe[2], report_pipe[2];
+            unique_lock<mutex> fork_lock(fork_mutex());
+
+            open_pipe(out_pipe);
+            try {
+               open_pipe(report_pipe);
+            } catch (...) {
+               close(out_pipe[0]);
+               close(out_pipe[1]);
+               throw;
+            }
+
+            // Don't let the child inherit and then repeat buffered output.
+            out.flush();
+            cout.flush();
+            cerr.flush();
+            fflush(nullptr);
+
+            const long rss_start = peak_rss_kb();
+            const auto start = chrono::steady_clock::now();
+            pid_t pid = fork();
+
+            if (pid < 0) {
+               int fork_errno = errno;
+               close(out_pipe[0]);
+               close(out_pipe[1]);
+               close(report_pipe[0]);
+               close(report_pipe[1]);
+               throw TestException(tfm::format("Failed to fork test: %s", strerror(fork_errno)));
+
+            } else if (pid == 0) {
+               close(out_pipe[0]);
+               close(report_pipe[0]);
+               dup2(out_pipe[1], STDOUT_FILENO);
+               dup2(out_pipe[1], STDERR_FILENO);
+               close(out_pipe[1]);
+
+               // Send output straight to the pipe even if this thread
+               // was capturing it.  Crash reports are written to stderr,
+               // and so also reach the parent.
+               ThreadCaptureBuf::target() = nullptr;
+
+               ChildReport report = {0, {0, 0, 0}, 0};
+               string error;
+               try {
+                  Outcome outcome = execute(test, cout);
+                  report.passed = outcome.passed;
+                  report.allocs = outcome.stats.allocs;
+                  error = outcome.error.substr(0, 4096);
+               } catch (...) {
+                  error = "(unknown exception)";
+               }
+               cout.flush();
+               cerr.flush();
+
+               report.error_length = error.size();
+               write_fully(report_pipe[1], &report, sizeof(report));
+               write_fully(report_pipe[1], error.data(), error.size());
+               _exit(0);
+            }
+
+            close(out_pipe[1]);
+            close(report_pipe[1]);
+            fork_lock.unlock();
+
+            // The child may close its output and still hang, so wait for
+            // its report under the same deadline.
+            bool timed_out = ! copy_output(out_pipe[0], out, start + timeout) ||
+               ! wait_readable(report_pipe[0], start + timeout);
+            if (timed_out) {
+               kill(pid, SIGKILL);
+            }
+            close(out_pipe[0]);
+
+            int status = 0;
+            struct rusage usage;
+            while (wait4(pid, &status, 0, &usage) < 0 && errno == EINTR) { }
+
+            Outcome outcome;
+            outcome.stats.wall_ns = chrono::duration<double, nano>(
+               chrono::steady_clock::now() - start).count();
+            outcome.stats.cpu_ns =
+               (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1e9 +
+               (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) * 1e3;
+            outcome.stats.peak_rss_delta_kb = max(0L, (long)usage.ru_maxrss - rss_start);
+
+            ChildReport report;
+            if (timed_out) {
+               outcome.error = tfm::format("(timeout): Test exceeded %dms.", timeout.count());
+
+            } else if (read_fully(report_pipe[0], &report, sizeof(report))) {
+               outcome.passed = report.passed;
+               outcome.stats.allocs = report.allocs;
+               outcome.error.resize(report.error_length);
+               if (! read_fully(report_pipe[0], &outcome.error[0], report.error_length)) {
+                  outcome.error = "(unknown exception)";
+               }
+
+            } else if (WIFSIGNALED(status)) {
+               outcome.error = tfm::format("(signal): Test killed by signal %d (%s).",
+                                           WTERMSIG(status), strsignal(WTERMSIG(status)));
+            } else {
+               outcome.error = tfm::format("(exit): Test exited with status %d.",
+                                           WEXITSTATUS(status));
+            }
+
+            close(report_pipe[0]);
+            return outcome;
+         }
+
+         /**
+          * Copy everything from fd to out until EOF, or return false if
+          * the deadline passes first.
+          */
+         static bool copy_output(int fd, ostream& out,
+                                 chrono::steady_clock::time_point deadline) {
+            char buffer[4096];
+
+            for (;;) {
+               if (! wait_readable(fd, deadline)) {
+                  return false;
+               }
+
+               ssize_t len = read(fd, buffer, sizeof(buffer));
+               if (len < 0 && errno == EINTR) {
+                  continue;
+               } else if (len <= 0) {
+                  return true;
+               }
+               out.write(buffer, len);
+            }
+         }
+
+         /**
+          * Wait until fd is readable or at EOF, or return false if the
+          * deadline passes first.
+          */
+         static bool wait_readable(int fd, chrono::steady_clock::time_point deadline) {
+            for (;;) {
+               auto remaining = chrono::duration_cast<chrono::milliseconds>(
+                  deadline - chrono::steady_clock::now());
+               if (remaining.count() <= 0) {
+                  return false;
+               }
+
+               struct pollfd pfd = {fd, POLLIN, 0};
+               int ready = poll(&pfd, 1, remaining.count());
+               if (ready > 0) {
+                  return true;
+               } else if (ready == 0 || errno != EINTR) {
+                  return false;
+               }
+            }
+         }
+
+         static void write_fully(int fd, const void* data, size_t length) {
+            const char* ptr = static_cast<const char*>(data);
+            while (length > 0) {
+               ssize_t len = write(fd, ptr, length);
+               if (len < 0 && errno == EINTR) {
+                  continue;
+               } else if (len <= 0) {
+                  return;
+               }
+               ptr += len;
+               length -= len;
+            }
+         }
+
+         static bool read_fully(int fd, void* data, size_t length) {
+            char* ptr = static_cast<char*>(data);
+            while (length > 0) {
+               ssize_t len = read(fd, ptr, length);
+               if (len < 0 && errno == EINTR) {
+                  continue;
+               } else if (len <= 0) {
+                  return false;
+               }
+               ptr += len;
+               length -= len;
+            }
+            return true;
+         }
+#endif
+
+#ifndef LAIN_TESTING_POSIX
          static void signal_callback(int signal) {
             cerr << endl << "FATAL: Caught signal " << signal
                << " (" << strsignal(signal) << ")"
@@ -128,9 +722,46 @@ namespace lain {
 #endif
             exit(1);
          }
+#endif
+
+         int run_parallel(ostream& out) const {
+            vector<ostringstream> outputs(tests.size());
+            vector<int> failures(tests.size(), 0);
+
+            {
+               ThreadCaptureBuf capture_out(cout), capture_err(cerr);
+               ThreadPool pool(num_threads);
+
+               pool.parallel_for(tests.size(), [&](int x) {
+                  if (! tests[x].is_exclusive()) {
+                     CaptureScope scope(outputs[x].rdbuf());
+                     failures[x] = run_test(tests[x], outputs[x]);
+                  }
+               });
+
+               for (size_t x = 0; x < tests.size(); x++) {
+                  if (tests[x].is_exclusive()) {
+                     CaptureScope scope(outputs[x].rdbuf());
+                     failures[x] = run_test(tests[x], outputs[x]);
+                  }
+               }
+            }
+
+            int tests_failed = 0;
+            for (size_t x = 0; x < tests.size(); x++) {
+               out << outputs[x].str();
+               tests_failed += failures[x];
+            }
+            return tests_failed;
+         }
 
          vector<UnitTest> tests;
          string name;
+         unsigned int num_threads = 0;
+         chrono::milliseconds default_timeout = chrono::milliseconds(0);
+#ifdef LAIN_TESTING_BENCHMARKS
+         shared_ptr<BenchmarkState> benchmarks = make_shared<BenchmarkState>();
+#endif
       };
 
       inline void assert_true(bool expr, const string& message = "Assertion failed.") {
@@ -190,6 +821,49 @@ namespace lain {
          }
       }
 
+      /**
+       * Call fn and return the allocations it made on the calling
+       * thread.  Throws TestException if the allocation hook is not
+       * installed, see alloc_hook.h.
+       */
+      template<class F>
+      inline alloc::AllocationCounts count_allocations(F fn) {
+         if (! alloc::hook_installed()) {
+            throw TestException("Allocation assertions require LAIN_INSTALL_ALLOC_HOOK.");
+         }
+
+         alloc::AllocationCounts start = alloc::thread_counts();
+         fn();
+         return alloc::thread_counts() - start;
+      }
+
+      template<class F>
+      inline void assert_max_allocations(size_t max_allocations, F fn,
+            const string& message = "") {
+         alloc::AllocationCounts allocs = count_allocations(fn);
+         if (allocs.allocations > max_allocations) {
+            throw AssertionFailed(message != "" ? message : tfm::format(
+               "Expected at most %d allocations, got %d (%d bytes).",
+               max_allocations, allocs.allocations, allocs.bytes));
+         }
+      }
+
+      template<class F>
+      inline void assert_max_allocated_bytes(size_t max_bytes, F fn,
+            const string& message = "") {
+         alloc::AllocationCounts allocs = count_allocations(fn);
+         if (allocs.bytes > max_bytes) {
+            throw AssertionFailed(message != "" ? message : tfm::format(
+               "Expected at most %d bytes allocated, got %d in %d allocations.",
+               max_bytes, allocs.bytes, allocs.allocations));
+         }
+      }
+
+      template<class F>
+      inline void assert_no_allocations(F fn, const string& message = "") {
+         assert_max_allocations(0, fn, message);
+      }
+
       template<class T>
       inline size_t generic_list_size(const T& listA) {
          size_t sz = 0;
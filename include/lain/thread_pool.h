@@ -0,0 +1,221 @@
+/*
+ * thread_pool.h: A reusable work-stealing thread pool.
+ *
+ * Author: Lain Supe (lainproliant)
+ */
+#ifndef __LAIN_THREAD_POOL_H
+#define __LAIN_THREAD_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace lain {
+   using namespace std;
+
+   /**
+    * A fixed-size pool of worker threads.  Each worker has its own
+    * task queue, taking work from the front of its own queue and
+    * stealing from the back of the others' queues when idle.
+    *
+    * Threads blocked in parallel_for() run queued tasks while they
+    * wait, so parallel_for() may safely be nested inside of tasks.
+    */
+   class ThreadPool {
+   public:
+      ThreadPool(unsigned int num_threads = thread::hardware_concurrency()) {
+         if (num_threads == 0) {
+            num_threads = 1;
+         }
+
+         for (unsigned int x = 0; x < num_threads; x++) {
+            queues.emplace_back(new TaskQueue());
+         }
+
+         for (unsigned int x = 0; x < num_threads; x++) {
+            threads.emplace_back([this, x]() { worker_loop(x); });
+         }
+      }
+
+      ThreadPool(const ThreadPool&) = delete;
+      ThreadPool& operator=(const ThreadPool&) = delete;
+
+      virtual ~ThreadPool() {
+         {
+            lock_guard<mutex> lock(idle_mutex);
+            stopping = true;
+         }
+         idle_cv.notify_all();
+
+         for (thread& t : threads) {
+            t.join();
+         }
+      }
+
+      /**
+       * A process-wide pool with one worker per hardware thread.
+       */
+      static ThreadPool& shared() {
+         static ThreadPool pool;
+         return pool;
+      }
+
+      /**
+       * Queue a task for execution on one of the workers.  Tasks
+       * submitted from a worker go to that worker's own queue.
+       */
+      void submit(function<void()> task) {
+         size_t id = current_worker_id();
+         if (id >= queues.size()) {
+            id = next_queue++ % queues.size();
+         }
+
+         {
+            lock_guard<mutex> lock(queues[id]->m);
+            queues[id]->tasks.push_back(move(task));
+         }
+
+         {
+            lock_guard<mutex> lock(idle_mutex);
+            pending++;
+         }
+         idle_cv.notify_one();
+      }
+
+      /**
+       * Call f(i) for each i in [0, n) on the pool, returning once
+       * every call has completed.  The first exception thrown by any
+       * call is rethrown here after all calls have finished.
+       */
+      template<class F>
+      void parallel_for(int n, F f) {
+         atomic<int> remaining(n);
+         mutex done_mutex;
+         condition_variable done_cv;
+         exception_ptr error;
+
+         for (int i = 0; i < n; i++) {
+            submit([&, i]() {
+               try {
+                  f(i);
+
+               } catch (...) {
+                  lock_guard<mutex> lock(done_mutex);
+                  if (! error) {
+                     error = current_exception();
+                  }
+               }
+
+               lock_guard<mutex> lock(done_mutex);
+               if (--remaining == 0) {
+                  done_cv.notify_all();
+               }
+            });
+         }
+
+         function<void()> task;
+         while (remaining > 0) {
+            if (try_pop(current_worker_id(), task)) {
+               task();
+
+            } else {
+               unique_lock<mutex> lock(done_mutex);
+               done_cv.wait(lock, [&]() { return remaining == 0; });
+            }
+         }
+
+         // Wait for the last task to release done_mutex before the
+         // mutex and condition variable go out of scope.
+         lock_guard<mutex> lock(done_mutex);
+         if (error) {
+            rethrow_exception(error);
+         }
+      }
+
+      size_t size() const {
+         return threads.size();
+      }
+
+   private:
+      struct TaskQueue {
+         mutex m;
+         deque<function<void()>> tasks;
+      };
+
+      struct WorkerIdentity {
+         const ThreadPool* pool;
+         size_t id;
+      };
+
+      static WorkerIdentity& current_worker() {
+         static thread_local WorkerIdentity identity = {nullptr, SIZE_MAX};
+         return identity;
+      }
+
+      size_t current_worker_id() const {
+         const WorkerIdentity& identity = current_worker();
+         return identity.pool == this ? identity.id : SIZE_MAX;
+      }
+
+      bool try_pop(size_t id, function<void()>& task) {
+         if (id < queues.size()) {
+            lock_guard<mutex> lock(queues[id]->m);
+            if (! queues[id]->tasks.empty()) {
+               task = move(queues[id]->tasks.front());
+               queues[id]->tasks.pop_front();
+               pending--;
+               return true;
+            }
+         }
+
+         for (size_t x = 1; x <= queues.size(); x++) {
+            TaskQueue& victim = *queues[(id + x) % queues.size()];
+            lock_guard<mutex> lock(victim.m);
+            if (! victim.tasks.empty()) {
+               task = move(victim.tasks.back());
+               victim.tasks.pop_back();
+               pending--;
+               return true;
+            }
+         }
+
+         return false;
+      }
+
+      void worker_loop(size_t id) {
+         current_worker() = {this, id};
+         function<void()> task;
+
+         for (;;) {
+            if (try_pop(id, task)) {
+               task();
+               task = nullptr;
+               continue;
+            }
+
+            unique_lock<mutex> lock(idle_mutex);
+            idle_cv.wait(lock, [&]() { return stopping || pending > 0; });
+            if (stopping && pending == 0) {
+               return;
+            }
+         }
+      }
+
+      vector<unique_ptr<TaskQueue>> queues;
+      vector<thread> threads;
+      mutex idle_mutex;
+      condition_variable idle_cv;
+      atomic<long> pending {0};
+      atomic<size_t> next_queue {0};
+      bool stopping = false;
+   };
+}
+
+#endif
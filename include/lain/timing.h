@@ -0,0 +1,60 @@
+/*
+ * timing.h: Small primitives shared by benchmarks and tests: compiler
+ *    barriers which keep measured work from being optimized away, and
+ *    formatting of durations.
+ *
+ * Author: Lain Supe (lainproliant)
+ */
+#ifndef __LAIN_TIMING_H
+#define __LAIN_TIMING_H
+
+#include <string>
+
+#include "tinyformat/tinyformat.h"
+
+namespace lain {
+   namespace bench {
+      using namespace std;
+
+      /**
+       * Prevent the compiler from optimizing away the computation of
+       * value, without otherwise changing the generated code.
+       */
+      template<class T>
+      inline void do_not_optimize(const T& value) {
+#if defined(__GNUC__) || defined(__clang__)
+         asm volatile("" : : "r,m"(value) : "memory");
+#else
+         volatile const T* sink = &value;
+         (void)sink;
+#endif
+      }
+
+      /**
+       * Force the compiler to assume all memory may have been read
+       * or written, so pending stores can't be elided.
+       */
+      inline void clobber_memory() {
+#if defined(__GNUC__) || defined(__clang__)
+         asm volatile("" : : : "memory");
+#endif
+      }
+
+      /**
+       * Format a duration in nanoseconds with a sensible unit.
+       */
+      inline string format_ns(double ns) {
+         if (ns >= 1e9) {
+            return tfm::format("%.3fs", ns / 1e9);
+         } else if (ns >= 1e6) {
+            return tfm::format("%.3fms", ns / 1e6);
+         } else if (ns >= 1e3) {
+            return tfm::format("%.3fus", ns / 1e3);
+         } else {
+            return tfm::format("%.1fns", ns);
+         }
+      }
+   }
+}
+
+#endif
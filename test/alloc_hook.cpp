@@ -0,0 +1,139 @@
+#define LAIN_TESTING_POSIX
+#define LAIN_INSTALL_ALLOC_HOOK
+#include "lain/alloc_hook.h"
+#include "lain/testing.h"
+#include "lain/macros.h"
+
+#include <thread>
+
+using namespace std;
+using namespace lain;
+using namespace lain::testing;
+
+int main(int argc, char** argv) {
+   UNUSED(argc); UNUSED(argv);
+
+   return TestSuite("allocation hook (alloc_hook.h) tests")
+      .die_on_signal(SIGSEGV)
+      .test("Hook is installed", [&]()->bool {
+         return alloc::hook_installed();
+      })
+      .test("Allocations are counted per thread", [&]()->bool {
+         alloc::AllocationCounts start = alloc::thread_counts();
+         {
+            unique_ptr<int> single(new int(42));
+            unique_ptr<char[]> array(new char[100]);
+         }
+         alloc::AllocationCounts delta = alloc::thread_counts() - start;
+
+         assert_equal(delta.allocations, (size_t)2);
+         assert_equal(delta.deallocations, (size_t)2);
+         assert_equal(delta.bytes, sizeof(int) + 100);
+         return true;
+      })
+      .test("Other threads' allocations are not counted", [&]()->bool {
+         alloc::AllocationCounts start = alloc::thread_counts();
+         alloc::AllocationCounts other_delta = {0, 0, 0};
+         thread t([&]() {
+            alloc::AllocationCounts other_start = alloc::thread_counts();
+            vector<int> vec(1000);
+            do_not_optimize(vec.data());
+            other_delta = alloc::thread_counts() - other_start;
+         });
+         t.join();
+         alloc::AllocationCounts delta = alloc::thread_counts() - start;
+
+         assert_equal(other_delta.allocations, (size_t)1);
+         assert_equal(other_delta.bytes, 1000 * sizeof(int));
+         assert_true(delta.bytes < 1000 * sizeof(int));
+         return true;
+      })
+      .test("Test stats report allocations", [&]()->bool {
+         ostringstream sout;
+         TestSuite("internal test suite")
+            .test("allocating test", []()->bool {
+               vector<int> vec(1000);
+               return vec.size() == 1000;
+            })
+            .run(sout);
+
+         cout << sout.str();
+         assert_true(sout.str().find("1 allocations, 4000 bytes") != string::npos);
+         return true;
+      })
+      .test("Forked test stats report allocations", [&]()->bool {
+         ostringstream sout;
+         TestSuite("internal test suite")
+            .timeout(chrono::milliseconds(5000))
+            .test("allocating test", []()->bool {
+               vector<int> vec(1000);
+               return vec.size() == 1000;
+            })
+            .run(sout);
+
+         cout << sout.str();
+         assert_true(sout.str().find("1 allocations, 4000 bytes") != string::npos);
+         return true;
+      })
+      .test("Allocation assertions pass within limits", [&]()->bool {
+         int buffer[16];
+         assert_no_allocations([&]() {
+            fill(buffer, buffer + 16, 7);
+         });
+         assert_max_allocations(1, [&]() {
+            vector<int> vec(16);
+            do_not_optimize(vec.data());
+         });
+         assert_max_allocated_bytes(16 * sizeof(int), [&]() {
+            vector<int> vec(16);
+            do_not_optimize(vec.data());
+         });
+         return true;
+      })
+      .test("Allocation assertions fail when exceeded", [&]()->bool {
+         try {
+            assert_no_allocations([&]() {
+               string str(100, 'x');
+               do_not_optimize(str.data());
+            });
+            return false;
+         } catch (const AssertionFailed& e) {
+            cout << "Expected failure: " << e.what() << endl;
+         }
+
+         try {
+            assert_max_allocations(2, [&]() {
+               vector<unique_ptr<int>> ptrs;
+               for (int x = 0; x < 3; x++) {
+                  ptrs.emplace_back(new int(x));
+               }
+            });
+            return false;
+         } catch (const AssertionFailed& e) {
+            cout << "Expected failure: " << e.what() << endl;
+         }
+
+         try {
+            assert_max_allocated_bytes(10, [&]() {
+               vector<char> vec(11);
+               do_not_optimize(vec.data());
+            }, "custom message");
+            return false;
+         } catch (const AssertionFailed& e) {
+            assert_equal(string(e.what()), string("custom message"));
+         }
+         return true;
+      })
+      .test("Exceptions without stack traces don't allocate", [&]()->bool {
+         assert_no_allocations([]() {
+            try {
+               throw ValueException("short");
+            } catch (const Exception& e) {
+               do_not_optimize(e.what());
+               do_not_optimize(e.get_stacktrace().size());
+            }
+         });
+         return true;
+      })
+      .run();
+}
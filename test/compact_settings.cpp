@@ -0,0 +1,179 @@
+#define LAIN_TESTING_BENCHMARKS
+#define LAIN_INSTALL_ALLOC_HOOK
+#include "lain/alloc_hook.h"
+#include "lain/compact_settings.h"
+#include "lain/testing.h"
+
+using namespace std;
+using namespace lain;
+using namespace lain::testing;
+
+string make_large_json(int count) {
+   string json = "{\"items\": [";
+   for (int x = 0; x < count; x++) {
+      json += tfm::format("%s{\"id\": %d, \"name\": \"item\", \"tags\": [\"alpha\", \"bravo\"], \"weight\": 1.5}",
+                          x > 0 ? ", " : "", x);
+   }
+   return json + "]}";
+}
+
+int main() {
+   return TestSuite("compact_settings (compact_settings.h) tests")
+      .die_on_signal(SIGSEGV)
+      .test("CompactSettings-001: Loading settings from a file", [&]()->bool {
+         CompactSettings settings = CompactSettings::load_from_file("json/test001.json");
+         CompactSettings graphics_settings = settings.get_object("graphics", true);
+         assert_equal(graphics_settings.get<int>("width"), 1920);
+         assert_equal(graphics_settings.get<int>("height"), 1080);
+         assert_true(lists_equal(graphics_settings.get_keys(), {"height", "width"}));
+         return true;
+      })
+      .test("CompactSettings-002: Defaults, sets and saving", [&]()->bool {
+         CompactSettings settings;
+         CompactSettings graphics_settings = settings.get_object("graphics");
+
+         assert_equal(graphics_settings.get<int>("width", 1920), 1920);
+         assert_equal(graphics_settings.get<int>("height", 1080), 1080);
+         assert_false(graphics_settings.get<bool>("fullscreen", false));
+         assert_equal(graphics_settings.get<int>("width"), 1920);
+         graphics_settings.set("title", "lain");
+         graphics_settings.set<double>("gamma", 2.2);
+         graphics_settings.set<int>("width", 1280);
+
+         settings.set_object("graphics", graphics_settings);
+         settings.set_array<string>("names", {"alpha", "bra\"vo"});
+         settings.save_to_file("CompactSettings-002.json.output");
+         settings = CompactSettings::load_from_file("CompactSettings-002.json.output");
+
+         graphics_settings = settings.get_object("graphics", true);
+         assert_equal(graphics_settings.get<int>("width"), 1280);
+         assert_equal(graphics_settings.get<int>("height"), 1080);
+         assert_equal(graphics_settings.get<double>("gamma"), 2.2);
+         assert_equal(graphics_settings.get<string>("title"), string("lain"));
+         assert_true(lists_equal(settings.get_array<string>("names"), {"alpha", "bra\"vo"}));
+         return true;
+      })
+      .test("CompactSettings-003: Arrays, errors and non-throwing lookups", [&]()->bool {
+         CompactSettings settings = CompactSettings::load_from_file("json/test004.json");
+         assert_true(lists_equal(settings.get_array<int>("numbers"), {1, 2, 3, 4, 5}));
+         assert_true(lists_equal(settings.get_array<string>("strings"),
+                                 {"alpha", "bravo", "charlie", "delta", "eagle"}));
+
+         vector<int> numbers;
+         assert_false(settings.try_get_array<int>("strings", numbers));
+         assert_true(numbers.empty());
+         assert_true(lists_equal(settings.get_array<int>("missing", {7}), {7}));
+         assert_true(lists_equal(settings.get_array<int>("missing"), {7}));
+
+         int value = 3;
+         assert_false(settings.try_get<int>("strings", value));
+         assert_equal(value, 3);
+
+         CompactSettings mixed = CompactSettings::load_from_file("json/test006.json");
+         try {
+            mixed.get_array<int>("numbers");
+
+         } catch (const SettingsException& e) {
+            cerr << "Received expected SettingsException: "
+                 << e.get_message()
+                 << endl;
+            return true;
+         }
+
+         return false;
+      })
+      .test("CompactSettings-004: Child objects are views of their parent", [&]()->bool {
+         CompactSettings settings = CompactSettings::load_from_string(
+            "{\"a\": {\"b\": {\"c\": 1}}, \"list\": [{\"x\": 1}, {\"x\": 2}]}");
+
+         CompactSettings b = settings.get_object("a").get_object("b");
+         b.set<int>("c", 2);
+         assert_equal(settings.get_object("a").get_object("b").get<int>("c"), 2);
+
+         vector<CompactSettings> list = settings.get_object_array("list");
+         assert_equal(list.size(), (size_t)2);
+         assert_equal(list[1].get<int>("x"), 2);
+
+         list[0].set<int>("y", 3);
+         settings.set_object_array("copied", list);
+         assert_equal(settings.get_object_array("copied")[0].get<int>("y"), 3);
+
+         // Objects may be copied into themselves and their descendants.
+         CompactSettings tree = CompactSettings::load_from_string("{\"a\": {\"b\": 1}}");
+         tree.set_object("self", tree);
+         tree.get_object("a").set_object("up", tree);
+         tree.set_object_array("all", {tree, tree.get_object("a")});
+         assert_equal(tree.get_object("self").to_string(), string("{\"a\":{\"b\":1}}"));
+         assert_equal(tree.get_object("a").get_object("up").to_string(),
+                      string("{\"a\":{\"b\":1},\"self\":{\"a\":{\"b\":1}}}"));
+         assert_equal(tree.get_object_array("all")[1].get_keys().size(), (size_t)2);
+         return true;
+      })
+      .test("CompactSettings-005: Serialization matches Settings", [&]()->bool {
+         const string json = "{\"z\": [1, 2.5, \"s\\n\", true, null, {}], \"a\": {\"k\": []}, \"dup\": 1, \"dup\": 2}";
+         CompactSettings compact = CompactSettings::load_from_string(json);
+         Settings settings = Settings::load_from_string(json);
+
+         assert_equal(compact.to_string(), settings.to_string());
+         assert_equal(compact.to_string(true), settings.to_string(true));
+         assert_equal(compact.get<int>("dup"), 2);
+         return true;
+      })
+      .test("CompactSettings-006: Loading uses fewer allocations than Settings", [&]()->bool {
+         const string json = make_large_json(1000);
+
+         alloc::AllocationCounts compact_allocs = count_allocations([&]() {
+            CompactSettings settings = CompactSettings::load_from_string(json);
+            do_not_optimize(settings);
+         });
+         alloc::AllocationCounts settings_allocs = count_allocations([&]() {
+            Settings settings = Settings::load_from_string(json);
+            do_not_optimize(settings);
+         });
+
+         cout << "CompactSettings: " << compact_allocs.allocations << " allocations, "
+              << compact_allocs.bytes << " bytes" << endl;
+         cout << "Settings: " << settings_allocs.allocations << " allocations, "
+              << settings_allocs.bytes << " bytes" << endl;
+
+         assert_true(compact_allocs.allocations * 20 < settings_allocs.allocations);
+         assert_true(compact_allocs.bytes < settings_allocs.bytes);
+         return true;
+      })
+      .test("CompactSettings-007: Lookups don't allocate", [&]()->bool {
+         CompactSettings settings = CompactSettings::load_from_file("json/test001.json");
+         CompactSettings graphics_settings = settings.get_object("graphics", true);
+         const string width = "width", missing = "missing";
+         int value = 0;
+
+         assert_no_allocations([&]() {
+            value = graphics_settings.get<int>(width) + graphics_settings.get_default<int>(missing, 1);
+         });
+         assert_equal(value, 1921);
+         return true;
+      })
+      .test("CompactSettings-008: Paths and JSON Pointers", [&]()->bool {
+         CompactSettings settings = CompactSettings::load_from_string(
+            "{\"a\": {\"b\": [{\"c\": 1}, {\"c\": 2}]}, \"a/b\": 3}");
+         const SettingsPath path("a.b[1].c");
+
+         assert_equal(settings.get<int>(path), 2);
+         assert_equal(settings.at_path("a.b[0]").get<int>("c"), 1);
+         assert_equal(settings.at_pointer("/a/b/1").get<int>("c"), 2);
+         assert_equal(settings.get<int>(SettingsPath::pointer("/a~1b")), 3);
+         assert_false(settings.contains(SettingsPath("a.b[2]")));
+         assert_equal(settings.get_default<int>(SettingsPath("a.x"), 7), 7);
+
+         int value = 0;
+         assert_no_allocations([&]() {
+            value = settings.get<int>(path);
+         });
+         assert_equal(value, 2);
+         return true;
+      })
+      .benchmark("CompactSettings-009: Loading 1000 objects", [&]() {
+         static const string json = make_large_json(1000);
+         do_not_optimize(CompactSettings::load_from_string(json));
+      })
+      .run();
+}
@@ -0,0 +1,153 @@
+#include "lain/crash_handler.h"
+#include "lain/testing.h"
+#include "lain/macros.h"
+
+#include <sys/wait.h>
+
+#include <atomic>
+#include <thread>
+
+using namespace std;
+using namespace lain;
+using namespace lain::testing;
+
+/**
+ * Run fn in a child process with the crash handler installed, writing
+ * reports to a pipe.  Returns the report and sets status to the
+ * child's wait status.
+ */
+template<class F>
+string crash_in_child(F fn, int& status) {
+   int fds[2];
+   assert_true(pipe(fds) == 0, "Failed to create pipe.");
+
+   pid_t pid = fork();
+   if (pid == 0) {
+      close(fds[0]);
+      crash::install_fatal(fds[1]);
+      fn();
+      _exit(0);
+   }
+
+   close(fds[1]);
+   string report;
+   char buffer[4096];
+   ssize_t len;
+   while ((len = read(fds[0], buffer, sizeof(buffer))) > 0) {
+      report.append(buffer, len);
+   }
+   close(fds[0]);
+   waitpid(pid, &status, 0);
+   return report;
+}
+
+int __attribute__((noinline)) recurse_forever(int depth) {
+   volatile char pad[1024];
+   pad[0] = depth;
+   if (depth < 0) {
+      return 0;
+   }
+   return recurse_forever(depth + 1) + pad[0];
+}
+
+void __attribute__((noinline)) raise_sigfpe() {
+   raise(SIGFPE);
+}
+
+size_t count_of(const string& text, const string& pattern) {
+   size_t count = 0;
+   for (size_t pos = text.find(pattern); pos != string::npos; pos = text.find(pattern, pos + 1)) {
+      count++;
+   }
+   return count;
+}
+
+int main(int argc, char** argv) {
+   UNUSED(argc); UNUSED(argv);
+
+   return TestSuite("crash handler (crash_handler.h) tests")
+      .test("Segfault writes a report and re-raises", [&]()->bool {
+         int status = 0;
+         string report = crash_in_child([]() {
+            volatile int* ptr = nullptr;
+            *ptr = 42;
+         }, status);
+
+         cout << report;
+         assert_true(WIFSIGNALED(status) && WTERMSIG(status) == SIGSEGV,
+                     "Child did not die by SIGSEGV.");
+         assert_true(report.find("FATAL: Caught signal 11 (SIGSEGV), fault address 0x0") != string::npos);
+         assert_true(report.find("#0 0x") != string::npos);
+         assert_true(report.find("crash_handler") != string::npos,
+                     "Frames were not resolved to the test binary.");
+         assert_true(report.find("End of stack trace.") != string::npos);
+         return true;
+      })
+      .test("Abort is reported", [&]()->bool {
+         int status = 0;
+         string report = crash_in_child([]() { abort(); }, status);
+
+         assert_true(WIFSIGNALED(status) && WTERMSIG(status) == SIGABRT);
+         assert_true(report.find("(SIGABRT)") != string::npos);
+         return true;
+      })
+      .test("Stack overflow is reported on the alternate stack", [&]()->bool {
+         int status = 0;
+         string report = crash_in_child([]() { recurse_forever(0); }, status);
+
+         assert_true(WIFSIGNALED(status) && WTERMSIG(status) == SIGSEGV);
+         assert_true(report.find("(SIGSEGV)") != string::npos);
+         assert_true(report.find("End of stack trace.") != string::npos);
+         return true;
+      })
+      .test("Reports can be symbolized offline", [&]()->bool {
+         int status = 0;
+         string report = crash_in_child([]() { raise_sigfpe(); }, status);
+         string symbolized = crash::symbolize_report(report);
+
+         cout << symbolized;
+         assert_true(symbolized.find("(SIGFPE)") != string::npos);
+         assert_true(symbolized.find(" in raise_sigfpe() at ") != string::npos,
+                     "The faulting function was not symbolized.");
+         assert_true(symbolized.find("crash_handler.cpp:") != string::npos,
+                     "No frame was resolved to a source location.");
+         return true;
+      })
+      .test("Concurrent faults write a single report", [&]()->bool {
+         int status = 0;
+         string report = crash_in_child([]() {
+            atomic<int> ready(0);
+            atomic<bool> go(false);
+            auto fault = [&]() {
+               ready++;
+               while (! go) { }
+               volatile int* ptr = nullptr;
+               *ptr = 42;
+            };
+
+            thread a(fault), b(fault);
+            while (ready < 2) { }
+            go = true;
+            a.join();
+            b.join();
+         }, status);
+
+         assert_true(WIFSIGNALED(status) && WTERMSIG(status) == SIGSEGV);
+         assert_equal(count_of(report, "FATAL: Caught signal"), (size_t)1);
+         assert_equal(count_of(report, "End of stack trace."), (size_t)1);
+         return true;
+      })
+      .test("Symbolizing doesn't pass module paths through a shell", [&]()->bool {
+         const string marker = "CrashHandler-003.output";
+         unlink(marker.c_str());
+
+         string report = "#0 /tmp/x';touch${IFS}" + marker + ";'+0x10\n"
+                         "#1 /tmp/y+0x10;touch${IFS}" + marker + "\n";
+         string symbolized = crash::symbolize_report(report);
+
+         assert_equal(symbolized, report);
+         assert_true(access(marker.c_str(), F_OK) != 0, "A shell command was injected.");
+         return true;
+      })
+      .run();
+}
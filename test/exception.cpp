@@ -0,0 +1,71 @@
+#define LAIN_ENABLE_STACKTRACE
+#define LAIN_INSTALL_ALLOC_HOOK
+#include "lain/alloc_hook.h"
+#include "lain/exception.h"
+#include "lain/testing.h"
+#include "lain/macros.h"
+
+using namespace std;
+using namespace lain;
+using namespace lain::testing;
+
+void __attribute__((noinline)) throw_value_exception(const string& message) {
+   throw ValueException(message);
+}
+
+int main(int argc, char** argv) {
+   UNUSED(argc); UNUSED(argv);
+
+   return TestSuite("exception (exception.h) tests")
+      .die_on_signal(SIGSEGV)
+      .test("Message is preserved", [&]()->bool {
+         string message = "a message long enough to not fit in a small string buffer";
+         try {
+            throw_value_exception(message);
+         } catch (const Exception& e) {
+            assert_equal(string(e.what()), message);
+            assert_equal(e.get_message(), message);
+            return true;
+         }
+         return false;
+      })
+      .test("Stack trace is symbolized on demand", [&]()->bool {
+         try {
+            throw_value_exception("oops");
+         } catch (const Exception& e) {
+            const vector<string>& stacktrace = e.get_stacktrace();
+            assert_true(stacktrace.size() > 0);
+            assert_true(&e.get_stacktrace() == &stacktrace);
+            assert_true(e.format_stacktrace().find("0: ") == 0);
+            cout << e.format_stacktrace();
+            return true;
+         }
+         return false;
+      })
+      .test("Capturing the stack doesn't allocate", [&]()->bool {
+         auto throw_and_catch = []() {
+            try {
+               throw ValueException("short");
+            } catch (const Exception& e) {
+               do_not_optimize(e.what());
+            }
+         };
+
+         // The first backtrace() may load libgcc.
+         throw_and_catch();
+         assert_no_allocations(throw_and_catch);
+         return true;
+      })
+      .test("Copies keep the captured stack", [&]()->bool {
+         Exception copy("");
+         try {
+            throw_value_exception("copied");
+         } catch (const Exception& e) {
+            copy = e;
+         }
+         assert_equal(copy.get_message(), string("copied"));
+         assert_true(copy.get_stacktrace().size() > 0);
+         return true;
+      })
+      .run();
+}
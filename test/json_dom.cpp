@@ -0,0 +1,74 @@
+#include "lain/json_dom.h"
+#include "lain/testing.h"
+
+using namespace std;
+using namespace lain;
+using namespace lain::testing;
+
+int main() {
+   return TestSuite("json_dom (json_dom.h) tests")
+      .die_on_signal(SIGSEGV)
+      .test("JsonDom-001: Nodes, members and elements", [&]()->bool {
+         auto doc = json::Document::parse(
+            "{\"b\": [1, \"two\", {\"c\": null}], \"a\": true, \"s\": \"esc\\taped\"}");
+         json::NodeId root = doc->root();
+
+         assert_true(doc->type(root) == json::Type::OBJECT);
+         assert_equal(doc->size(root), (size_t)3);
+         assert_true(lists_equal(doc->get_keys(root), {"a", "b", "s"}));
+         assert_true(doc->node(doc->find(root, "a")).boolean);
+         assert_equal(doc->find(root, "missing"), json::NO_NODE);
+
+         json::NodeId b = doc->find(root, "b");
+         assert_equal(doc->size(b), (size_t)3);
+         assert_equal(doc->node(doc->element(b, 0)).number, 1.0);
+         assert_equal(doc->get_string(doc->element(b, 1)).str(), string("two"));
+         assert_true(doc->type(doc->find(doc->element(b, 2), "c")) == json::Type::NULL_VALUE);
+         assert_equal(doc->get_string(doc->find(root, "s")).str(), string("esc\taped"));
+         return true;
+      })
+      .test("JsonDom-002: Keys are interned once per document", [&]()->bool {
+         auto doc = json::Document::parse("[{\"id\": 1, \"x\": 2}, {\"x\": 3, \"id\": 4}, {\"id\": 5}]");
+         assert_equal(doc->get_key_table().size(), (size_t)2);
+         assert_equal(doc->node(doc->find(doc->element(doc->root(), 1), "id")).number, 4.0);
+         return true;
+      })
+      .test("JsonDom-003: Adding members and copying subtrees", [&]()->bool {
+         auto doc = json::Document::parse("{\"m\": 1, \"z\": {\"k\": [1, 2]}}");
+         json::NodeId root = doc->root();
+
+         doc->set_number(doc->set_member(root, "a"), 3);
+         doc->set_number(doc->set_member(root, "m"), 4);
+         doc->copy(doc->set_member(root, "copy"), *doc, doc->find(root, "z"));
+
+         assert_equal(doc->size(root), (size_t)4);
+         assert_equal(doc->serialize(root),
+                      string("{\"a\":3,\"copy\":{\"k\":[1,2]},\"m\":4,\"z\":{\"k\":[1,2]}}"));
+
+         json::Document other;
+         other.set_object(other.root());
+         other.copy(other.set_member(other.root(), "from"), *doc, root);
+         assert_equal(other.serialize(other.root()),
+                      string("{\"from\":{\"a\":3,\"copy\":{\"k\":[1,2]},\"m\":4,\"z\":{\"k\":[1,2]}}}"));
+
+         // A node may be copied into one of its own descendants.
+         doc->copy(doc->set_member(doc->find(root, "z"), "up"), *doc, root);
+         assert_equal(doc->serialize(doc->find(root, "z")),
+                      string("{\"k\":[1,2],\"up\":{\"a\":3,\"copy\":{\"k\":[1,2]},\"m\":4,"
+                             "\"z\":{\"k\":[1,2],\"up\":null}}}"));
+         return true;
+      })
+      .test("JsonDom-004: Arena allocation", [&]()->bool {
+         json::Arena arena(64);
+         const char* small = arena.copy("abc", 3);
+         const char* large = arena.copy(string(100, 'x').c_str(), 100);
+         const char* next = arena.copy("def", 3);
+
+         assert_equal(string(small, 3), string("abc"));
+         assert_equal(string(large, 100), string(100, 'x'));
+         assert_true(next == small + 3);
+         assert_equal(arena.bytes_reserved(), (size_t)164);
+         return true;
+      })
+      .run();
+}
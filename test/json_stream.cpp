@@ -0,0 +1,180 @@
+#define LAIN_TESTING_BENCHMARKS
+#include "lain/json_stream.h"
+#include "lain/testing.h"
+
+using namespace std;
+using namespace lain;
+using namespace lain::testing;
+
+/**
+ * Records each event as a token, optionally skipping or stopping at
+ * a given key.
+ */
+class Recorder : public json::Handler {
+public:
+   json::Action start_object() override {
+      events.push_back("{");
+      return skip_containers ? json::Action::SKIP : json::Action::CONTINUE;
+   }
+
+   json::Action end_object() override {
+      events.push_back("}");
+      return json::Action::CONTINUE;
+   }
+
+   json::Action start_array() override {
+      events.push_back("[");
+      return json::Action::CONTINUE;
+   }
+
+   json::Action end_array() override {
+      events.push_back("]");
+      return json::Action::CONTINUE;
+   }
+
+   json::Action key(const json::StringRef& name) override {
+      events.push_back(name.str() + ":");
+      if (name == skip_key) {
+         return json::Action::SKIP;
+      } else if (name == stop_key) {
+         return json::Action::STOP;
+      }
+      return json::Action::CONTINUE;
+   }
+
+   json::Action null_value() override {
+      events.push_back("null");
+      return json::Action::CONTINUE;
+   }
+
+   json::Action bool_value(bool value) override {
+      events.push_back(value ? "true" : "false");
+      return json::Action::CONTINUE;
+   }
+
+   json::Action number_value(double value) override {
+      events.push_back(tfm::format("%g", value));
+      return json::Action::CONTINUE;
+   }
+
+   json::Action string_value(const json::StringRef& value) override {
+      events.push_back("'" + value.str() + "'");
+      return json::Action::CONTINUE;
+   }
+
+   vector<string> events;
+   string skip_key;
+   string stop_key;
+   bool skip_containers = false;
+};
+
+void assert_parse_error(const string& json, const string& expected) {
+   Recorder recorder;
+   try {
+      json::parse(json, recorder);
+
+   } catch (const json::JsonException& e) {
+      cerr << "Received expected JsonException: " << e.get_message() << endl;
+      assert_true(str::startsWith(e.get_message(), expected),
+                  tfm::format("Unexpected error message: %s", e.get_message()));
+      return;
+   }
+
+   assert_true(false, tfm::format("No exception thrown for '%s'.", json));
+}
+
+int main(int argc, char** argv) {
+   return TestSuite("json_stream (json_stream.h) tests")
+      .die_on_signal(SIGSEGV)
+      .test("JsonStream-001: Events are emitted in document order", [&]()->bool {
+         Recorder recorder;
+         assert_true(json::parse(
+            " {\"a\": [1, -2.5, 3e2], \"b\": {\"c\": null, \"d\": true}, \"e\": false, \"f\": \"g\"} ",
+            recorder));
+         assert_true(lists_equal(recorder.events, {
+            "{", "a:", "[", "1", "-2.5", "300", "]",
+            "b:", "{", "c:", "null", "d:", "true", "}",
+            "e:", "false", "f:", "'g'", "}"}));
+         return true;
+      })
+      .test("JsonStream-002: String escapes are decoded", [&]()->bool {
+         Recorder recorder;
+         json::parse("[\"plain\", \"a\\\"b\\\\c\\/d\\n\", \"\\u00e9\\u4e2d\\ud83d\\ude00\"]", recorder);
+         assert_true(lists_equal(recorder.events, {
+            "[", "'plain'", "'a\"b\\c/d\n'", "'\xc3\xa9\xe4\xb8\xad\xf0\x9f\x98\x80'", "]"}));
+         return true;
+      })
+      .test("JsonStream-003: Skipping subtrees by key and by container", [&]()->bool {
+         const string json = "{\"skip\": {\"x\": [1, {\"y\": \"]}\"}]}, \"keep\": 1}";
+
+         Recorder by_key;
+         by_key.skip_key = "skip";
+         json::parse(json, by_key);
+         assert_true(lists_equal(by_key.events, {"{", "skip:", "keep:", "1", "}"}));
+
+         Recorder by_container;
+         by_container.skip_containers = true;
+         json::parse(json, by_container);
+         assert_true(lists_equal(by_container.events, {"{"}));
+         return true;
+      })
+      .test("JsonStream-004: Stopping early", [&]()->bool {
+         Recorder recorder;
+         recorder.stop_key = "b";
+         assert_false(json::parse("{\"a\": 1, \"b\": 2, \"c\": 3}", recorder));
+         assert_true(lists_equal(recorder.events, {"{", "a:", "1", "b:"}));
+         return true;
+      })
+      .test("JsonStream-005: Buffers need not be null terminated", [&]()->bool {
+         const char buffer[] = {'[', '1', '2', ']', '3', '4'};
+         Recorder recorder;
+         json::parse(buffer, 4, recorder);
+         assert_true(lists_equal(recorder.events, {"[", "12", "]"}));
+
+         Recorder number;
+         json::parse(buffer + 1, 1, number);
+         assert_true(lists_equal(number.events, {"1"}));
+         return true;
+      })
+      .test("JsonStream-006: Malformed input is reported with its position", [&]()->bool {
+         assert_parse_error("", "JSON parse error at line 1, column 1: Unexpected end of input.");
+         assert_parse_error("{\"a\": 1,\n \"b\" 2}", "JSON parse error at line 2, column 6: Expected ':'");
+         assert_parse_error("[1, 2", "JSON parse error at line 1, column 6: Expected ',' or ']'");
+         assert_parse_error("{\"a\": tru}", "JSON parse error at line 1, column 7: Unexpected character.");
+         assert_parse_error("[\"\\x\"]", "JSON parse error at line 1, column 4: Invalid escape");
+         assert_parse_error("[\"\\ud800\"]", "JSON parse error at line 1, column 9: Unpaired surrogate");
+         assert_parse_error("[1] [2]", "JSON parse error at line 1, column 5: Unexpected characters");
+         assert_parse_error("{\"a\": {\"b\": 1}", "JSON parse error at line 1, column 15: Expected ',' or '}'");
+         return true;
+      })
+      .test("JsonStream-007: Nesting depth is limited", [&]()->bool {
+         string deep = string(600, '[') + string(600, ']');
+         assert_parse_error(deep, "JSON parse error at line 1, column 513: Maximum nesting depth");
+
+         Recorder recorder;
+         assert_true(json::parse(deep, recorder, 1000));
+         return true;
+      })
+      .test("JsonStream-008: Parsing a memory mapped file", [&]()->bool {
+         Recorder recorder;
+         assert_true(json::parse_file("json/test001.json", recorder));
+         assert_true(lists_equal(recorder.events, {
+            "{", "graphics:", "{", "width:", "1920", "height:", "1080", "}", "}"}));
+         return true;
+      })
+      .benchmark("JsonStream-009: Parsing 1000 objects", [&]() {
+         static string json;
+         if (json.empty()) {
+            json = "[";
+            for (int x = 0; x < 1000; x++) {
+               json += tfm::format("%s{\"id\": %d, \"name\": \"item\", \"tags\": [\"a\", \"b\"], \"weight\": 1.5}",
+                                   x > 0 ? ", " : "", x);
+            }
+            json += "]";
+         }
+
+         json::Handler handler;
+         do_not_optimize(json::parse(json, handler));
+      })
+      .run();
+}
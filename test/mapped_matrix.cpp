@@ -0,0 +1,92 @@
+#include "lain/mapped_matrix.h"
+#include "lain/testing.h"
+#include "lain/macros.h"
+
+#include <climits>
+#include <cstddef>
+#include <fstream>
+
+using namespace std;
+using namespace lain;
+using namespace lain::testing;
+
+struct Cell {
+   int16_t elevation;
+   uint8_t occupied;
+};
+
+int main(int argc, char** argv) {
+   UNUSED(argc); UNUSED(argv);
+
+   return TestSuite("mapped matrix (mapped_matrix.h) tests")
+      .die_on_signal(SIGSEGV)
+      .test("MappedMatrix create and reopen", [&]()->bool {
+         {
+            auto m = MappedMatrix<Cell>::create("MappedMatrix-001.output", 300, 200, {-1, 0});
+            assert_equal(m.width(), 300);
+            assert_equal(m.height(), 200);
+            assert_equal((int)m.at(299, 199).elevation, -1);
+
+            m.scan([](int x, int y, Cell& cell) {
+               cell.elevation = x - y;
+               cell.occupied = (x + y) % 2;
+               return true;
+            });
+         }
+
+         const auto m = MappedMatrix<Cell>::open("MappedMatrix-001.output");
+         assert_equal(m.size(), (size_t)300 * 200);
+         assert_equal((int)m.at(250, 10).elevation, 240);
+         assert_equal((int)m.at(3, 4).occupied, 1);
+
+         int occupied = 0;
+         m.scan([&](int, int, const Cell& cell) {
+            occupied += cell.occupied;
+            return true;
+         });
+         assert_equal(occupied, 300 * 200 / 2);
+
+         return true;
+      })
+      .test("MappedMatrix rejects mismatched element size", [&]()->bool {
+         MappedMatrix<double>::create("MappedMatrix-002.output", 4, 4, 1.5);
+
+         try {
+            MappedMatrix<float>::open("MappedMatrix-002.output");
+
+         } catch (const FileException& e) {
+            cerr << "Received expected FileException: " << e.get_message() << endl;
+            return true;
+         }
+
+         return false;
+      })
+      .test("MappedMatrix rejects dimensions that overflow", [&]()->bool {
+         try {
+            MappedMatrix<double>::create("MappedMatrix-003.output", INT_MAX, INT_MAX);
+            return false;
+
+         } catch (const FileException& e) {
+            cerr << "Received expected FileException: " << e.get_message() << endl;
+         }
+
+         MappedMatrix<Cell>::create("MappedMatrix-003.output", 4, 4);
+         {
+            fstream file("MappedMatrix-003.output", ios::in | ios::out | ios::binary);
+            const uint64_t dimensions[] = {(uint64_t)1 << 33, (uint64_t)1 << 33};
+            file.seekp(offsetof(MappedMatrixHeader, width));
+            file.write(reinterpret_cast<const char*>(dimensions), sizeof(dimensions));
+         }
+
+         try {
+            MappedMatrix<Cell>::open("MappedMatrix-003.output");
+
+         } catch (const FileException& e) {
+            cerr << "Received expected FileException: " << e.get_message() << endl;
+            return true;
+         }
+
+         return false;
+      })
+      .run();
+}
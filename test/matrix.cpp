@@ -1,4 +1,5 @@
 #include "lain/matrix.h"
+#include "lain/algorithms.h"
 #include "lain/testing.h"
 #include "lain/macros.h"
 
@@ -42,14 +43,14 @@ int main(int argc, char** argv) {
          assert_equal(m.height(), 5);
 
          cout << "----------" << endl;
-         m = m.resize(4, 2);
+         m.resize(4, 2);
          print_matrix(m);
          assert_equal(m.at(0, 0), 'a');
          assert_equal(m.width(), 4);
          assert_equal(m.height(), 2);
 
          cout << "----------" << endl;
-         m = m.resize(5, 3);
+         m.resize(5, 3);
          print_matrix(m);
          assert_equal(m.width(), 5);
          assert_equal(m.height(), 3);
@@ -59,7 +60,7 @@ int main(int argc, char** argv) {
          assert_equal(m.at(3, 1), 'i');
 
          cout << "----------" << endl;
-         m = m.resize(6, 1);
+         m.resize(6, 1);
          print_matrix(m);
          assert_equal(m.width(), 6);
          assert_equal(m.height(), 1);
@@ -72,7 +73,7 @@ int main(int argc, char** argv) {
          cout << "Resizing to " << BIG_MATRIX_WIDTH << "x" << BIG_MATRIX_HEIGHT
               << "..." << endl;
          auto start_time = steady_clock::now();
-         m = m.resize(BIG_MATRIX_WIDTH, BIG_MATRIX_HEIGHT);
+         m.resize(BIG_MATRIX_WIDTH, BIG_MATRIX_HEIGHT);
          int millis = duration_cast<milliseconds>(
                steady_clock::now() - start_time).count();
          cout << "Done. (" << millis << "ms)" << endl;
@@ -84,5 +85,220 @@ int main(int argc, char** argv) {
 
          return true;
       })
+      .test("Matrix generator and constant initialization", [&]()->bool {
+         Matrix<int> m(4, 3, [](int x, int y) { return x * 10 + y; });
+         assert_equal(m.at(3, 2), 32);
+
+         m.clear(7);
+         assert_equal(m.at(3, 2), 7);
+         m.clear();
+         assert_equal(m.at(3, 2), 0);
+         m.clear([](int x, int y) { return x + y; });
+         assert_equal(m.at(3, 2), 5);
+
+         int sum = 0;
+         const Matrix<int>& cm = m;
+         cm.scan([&](int, int, const int& val) {
+            sum += val;
+            return true;
+         });
+         assert_equal(sum, 30);
+
+         auto start_time = steady_clock::now();
+         Matrix<char> big(BIG_MATRIX_WIDTH, BIG_MATRIX_HEIGHT, '#');
+         int millis = duration_cast<milliseconds>(
+               steady_clock::now() - start_time).count();
+         cout << "Constructed " << BIG_MATRIX_WIDTH << "x" << BIG_MATRIX_HEIGHT
+              << " matrix. (" << millis << "ms)" << endl;
+         assert_equal(big.at(BIG_MATRIX_WIDTH - 1, BIG_MATRIX_HEIGHT - 1), '#');
+
+         return true;
+      })
+      .test("Matrix in-place resize", [&]()->bool {
+         Matrix<int> m(3, 3, [](int x, int y) { return -(x + y); });
+         m.at(2, 2) = 22;
+
+         m.resize(2, 2);
+         m.at(1, 1) = 11;
+         assert_equal(m.capacity_width(), 3);
+         assert_equal(m.capacity_height(), 3);
+
+         m.resize(4, 3);
+         assert_equal(m.capacity_width(), 6);
+         assert_equal(m.capacity_height(), 3);
+         assert_equal(m.at(1, 1), 11);
+         assert_equal(m.at(0, 0), 0);
+         assert_equal(m.at(1, 0), -1);
+
+         // The generator is only used during construction.
+         assert_equal(m.at(2, 2), 0);
+         assert_equal(m.at(3, 0), 0);
+         m.resize(5, 3, [](int x, int y) { return -(x + y); });
+         assert_equal(m.at(4, 2), -6);
+
+         Matrix<int, Tiled<4, 4>> tm(5, 5, 9);
+         for (int w = 6; w < 40; w += 3) {
+            tm.resize(w, w, [](int x, int y) { return x * y; });
+            assert_equal(tm.at(4, 4), 9);
+            assert_equal(tm.at(w - 1, 0), 0);
+            assert_equal(tm.at(w - 1, w - 1), (w - 1) * (w - 1));
+         }
+         assert_true(tm.capacity_width() >= 39);
+
+         tm.resize(3, 3).shrink_to_fit();
+         assert_equal(tm.capacity_width(), 4);
+         assert_equal(tm.at(2, 2), 9);
+
+         return true;
+      })
+      .test("Tiled matrix layout", [&]()->bool {
+         Matrix<int> rm(37, 21);
+         Matrix<int, Tiled<8, 4>> tm(37, 21);
+
+         rm.scan([&](int x, int y, int& val) {
+            val = y * 37 + x;
+            tm.at(x, y) = val;
+            return true;
+         });
+
+         for (int y = 0; y < rm.height(); y++) {
+            assert_true(equal(rm.row(y).begin(), rm.row(y).end(), tm.row(y).begin()));
+         }
+
+         for (int x = 0; x < rm.width(); x++) {
+            assert_true(equal(rm.column(x).begin(), rm.column(x).end(), tm.column(x).begin()));
+            assert_equal(tm.column(x)[20], 20 * 37 + x);
+         }
+
+         int visited = 0;
+         tm.scan_tiles([&](int x, int y, int& val) {
+            assert_equal(val, y * 37 + x);
+            visited++;
+            return true;
+         });
+         assert_equal(visited, tm.size());
+
+         auto tm2 = tm.resized(40, 3);
+         assert_equal(tm.width(), 37);
+         assert_equal(tm2.at(36, 2), 2 * 37 + 36);
+         assert_equal(tm2.at(39, 2), 0);
+
+         return true;
+      })
+      .test("Matrix parallel scan, transform and reduce", [&]()->bool {
+         ThreadPool pool(4);
+         Matrix<double, Tiled<>> m(1000, 700);
+
+         m.parallel_transform([](int x, int y, const double&) {
+            return x * 0.5 + y;
+         }, pool);
+         assert_equal(m.at(10, 20), 25.0);
+
+         auto sum = [](double acc, int, int, const double& val) { return acc + val; };
+         auto plus = [](double a, double b) { return a + b; };
+         double total = m.parallel_reduce(0.0, sum, plus, pool);
+         assert_equal(total, m.parallel_reduce(0.0, sum, plus));
+         assert_equal(total, 1000 * 700 * (999 * 0.25 + 349.5));
+
+         atomic<int> visited(0);
+         assert_true(m.parallel_scan([&](int, int, double&) {
+            visited++;
+            return true;
+         }, pool));
+         assert_equal(visited.load(), m.size());
+
+         assert_false(m.parallel_scan([&](int x, int y, double&) {
+            return ! (x == 500 && y == 350);
+         }, pool));
+
+         return true;
+      })
+      .test("Matrix row, column and region views", [&]()->bool {
+         Matrix<int> m(10, 8, [](int x, int y) { return y * 10 + x; });
+
+         Span<int> row = m.row(3);
+         assert_equal(row.size(), 10);
+         assert_true(row.data() == &m.at(0, 3));
+         fill(row.begin(), row.end(), -1);
+         assert_equal(m.at(9, 3), -1);
+
+         StridedSpan<int> column = m.column(4);
+         assert_equal(*max_element(column.begin(), column.end()), 74);
+         assert_true(column.end() - column.begin() == 8);
+         sort(column.begin(), column.end(), greater<int>());
+         assert_equal(m.at(4, 0), 74);
+
+         auto region = m.view(2, 4, 3, 2);
+         assert_true(&region.at(0, 0) == &m.at(2, 4));
+         assert_equal(alg::sum(region, 0), 42 + 43 + 24 + 52 + 53 + 14);
+         assert_true(lists_equal(alg::filter(vector<int>(region.begin(), region.end()),
+                                             [](int v) { return v % 2 == 0; }),
+                                 {42, 24, 52, 14}));
+
+         auto inner = region.view(1, 1, 2, 1);
+         inner.at(1, 0) = 1000;
+         assert_equal(m.at(4, 5), 1000);
+         assert_equal(inner.row(0)[0], 53);
+
+         const Matrix<int>& cm = m;
+         Matrix<int>::const_view_type cview = cm.view(8, 6, 2, 2);
+         assert_true(count(cview.begin(), cview.end(), 68) == 1);
+
+         auto it = m.view(2, 4, 3, 2).begin();
+         auto end = m.view(2, 4, 3, 2).end();
+         assert_equal(*it, 42);
+         assert_equal(distance(it, end), (ptrdiff_t)6);
+
+         auto gen = [](int x, int y) { return y * 10 + x; };
+         Matrix<int, Tiled<4, 4>> tm(10, 8, gen);
+         Matrix<int> rm(10, 8, gen);
+         auto tregion = tm.view(3, 2, 5, 5);
+         auto rregion = rm.view(3, 2, 5, 5);
+         assert_true(equal(tregion.begin(), tregion.end(), rregion.begin()));
+         for (int n = 0; n < 5; n++) {
+            assert_true(equal(tregion.row(n).begin(), tregion.row(n).end(),
+                              rregion.row(n).begin()));
+            assert_true(equal(tregion.column(n).begin(), tregion.column(n).end(),
+                              rregion.column(n).begin()));
+         }
+         for (int y = 0; y < tm.height(); y++) {
+            assert_true(equal(tm.row(y).begin(), tm.row(y).end(), rm.row(y).begin()));
+         }
+         for (int x = 0; x < tm.width(); x++) {
+            assert_true(equal(tm.column(x).begin(), tm.column(x).end(), rm.column(x).begin()));
+            assert_equal(tm.column(x)[7], rm.column(x)[7]);
+         }
+
+         return true;
+      })
+      .test("Tiled matrix column sweep", [&]()->bool {
+         Matrix<char> rm(BIG_MATRIX_WIDTH, BIG_MATRIX_HEIGHT, 'a');
+         Matrix<char, Tiled<>> tm(BIG_MATRIX_WIDTH, BIG_MATRIX_HEIGHT, 'a');
+         long rm_sum = 0, tm_sum = 0;
+
+         auto start_time = steady_clock::now();
+         for (int x = 0; x < rm.width(); x++) {
+            for (char c : rm.column(x)) {
+               rm_sum += c;
+            }
+         }
+         int rm_millis = duration_cast<milliseconds>(
+               steady_clock::now() - start_time).count();
+
+         start_time = steady_clock::now();
+         for (int x = 0; x < tm.width(); x++) {
+            for (char c : tm.column(x)) {
+               tm_sum += c;
+            }
+         }
+         int tm_millis = duration_cast<milliseconds>(
+               steady_clock::now() - start_time).count();
+
+         cout << "Column sweep: row-major " << rm_millis << "ms, tiled "
+              << tm_millis << "ms" << endl;
+         assert_equal(rm_sum, tm_sum);
+
+         return true;
+      })
       .run();
 }
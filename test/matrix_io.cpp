@@ -0,0 +1,118 @@
+#include "lain/matrix_io.h"
+#include "lain/testing.h"
+#include "lain/macros.h"
+
+#include <climits>
+#include <cstddef>
+#include <sstream>
+
+using namespace std;
+using namespace lain;
+using namespace lain::testing;
+
+int main(int argc, char** argv) {
+   UNUSED(argc); UNUSED(argv);
+
+   return TestSuite("matrix io (matrix_io.h) tests")
+      .die_on_signal(SIGSEGV)
+      .test("Matrix binary round trip", [&]()->bool {
+         Matrix<double> m(123, 45, [](int x, int y) { return x * 1.5 - y; });
+
+         for (bool compress : {false, true}) {
+            stringstream sb;
+            matrix_io::save(m, sb, compress);
+            Matrix<double> loaded = matrix_io::load<double>(sb);
+
+            assert_equal(loaded.width(), 123);
+            assert_equal(loaded.height(), 45);
+            assert_true(equal(loaded.view().begin(), loaded.view().end(), m.view().begin()));
+         }
+
+         return true;
+      })
+      .test("Matrix streaming in small bands with compression", [&]()->bool {
+         Matrix<short, Tiled<>> m(300, 50, 7);
+         for (int x = 0; x < 300; x += 3) {
+            m.at(x, 20) = x;
+         }
+
+         stringstream sb;
+         MatrixWriter<short> writer(sb, m.width(), m.height(), true, 4);
+         writer.write_rows(m);
+         writer.finish();
+         assert_true(sb.str().size() < (size_t)m.size() * sizeof(short) / 10);
+
+         MatrixReader<short> reader(sb);
+         Matrix<short> loaded(reader.width(), reader.height());
+         reader.read_rows(loaded);
+         assert_equal(loaded.at(0, 0), (short)7);
+         assert_equal(loaded.at(297, 20), (short)297);
+         assert_equal(loaded.at(298, 20), (short)7);
+
+         return true;
+      })
+      .test("Matrix stream corruption is detected", [&]()->bool {
+         Matrix<int> m(64, 64, [](int x, int y) { return x ^ y; });
+         stringstream sb;
+         matrix_io::save(m, sb);
+
+         string data = sb.str();
+         data[data.size() / 2] ^= 0x10;
+         stringstream corrupt(data);
+
+         try {
+            matrix_io::load<int>(corrupt);
+
+         } catch (const MatrixIOException& e) {
+            cerr << "Received expected MatrixIOException: " << e.get_message() << endl;
+            return true;
+         }
+
+         return false;
+      })
+      .test("Matrix save and load through files", [&]()->bool {
+         Matrix<char> m(4000, 100, '.');
+         m.at(3999, 99) = '#';
+
+         matrix_io::save(m, "MatrixIO-004.output", true);
+         Matrix<char> loaded = matrix_io::load<char>("MatrixIO-004.output");
+         assert_equal(loaded.at(3999, 99), '#');
+         assert_equal(loaded.at(3998, 99), '.');
+
+         return true;
+      })
+      .test("Matrix stream sizes are range checked", [&]()->bool {
+         // Bands of 4GiB can't be described by a band header.
+         try {
+            stringstream sb;
+            MatrixWriter<int> writer(sb, 1 << 20, 2048, false, 1024);
+            return false;
+
+         } catch (const MatrixIOException& e) {
+            cerr << "Received expected MatrixIOException: " << e.get_message() << endl;
+         }
+
+         Matrix<int> m(4, 4, 0);
+         stringstream sb;
+         matrix_io::save(m, sb);
+
+         for (size_t offset : {offsetof(matrix_io::Header, width),
+                               offsetof(matrix_io::Header, height)}) {
+            string data = sb.str();
+            const uint32_t too_large = (uint32_t)INT_MAX + 1;
+            memcpy(&data[offset], &too_large, sizeof(too_large));
+            stringstream forged(data);
+
+            try {
+               matrix_io::load<int>(forged);
+               return false;
+
+            } catch (const MatrixIOException& e) {
+               cerr << "Received expected MatrixIOException: " << e.get_message() << endl;
+            }
+         }
+
+         return true;
+      })
+      .run();
+}
@@ -0,0 +1,174 @@
+#include "lain/matrix_math.h"
+#include "lain/testing.h"
+#include "lain/macros.h"
+
+#include <chrono>
+#include <cstring>
+#include <vector>
+
+using namespace std;
+using namespace std::chrono;
+using namespace lain;
+using namespace lain::testing;
+
+int main(int argc, char** argv) {
+   UNUSED(argc); UNUSED(argv);
+
+   return TestSuite("matrix math (matrix_math.h) tests")
+      .die_on_signal(SIGSEGV)
+      .test("Elementwise and scalar operations", [&]()->bool {
+         Matrix<float> a(37, 11, [](int x, int y) { return x * 0.5f + y; });
+         Matrix<float> b(37, 11, [](int x, int y) { return (float)(x - y); });
+         Matrix<float> out(37, 11);
+
+         mat::add(a, b, out);
+         assert_equal(out.at(36, 10), 28.0f + 26.0f);
+         mat::sub(a, b, out);
+         assert_equal(out.at(36, 10), 28.0f - 26.0f);
+         mat::mul(a, b, out);
+         assert_equal(out.at(36, 10), 28.0f * 26.0f);
+         mat::fma(a, b, out);
+         assert_equal(out.at(36, 10), 2 * 28.0f * 26.0f);
+         mat::mul_scalar(a, 2.0f, a);
+         assert_equal(a.at(36, 10), 56.0f);
+         mat::add_scalar(a, -6.0f, a);
+         assert_equal(a.at(36, 10), 50.0f);
+
+         // Padded rows take the per-row path.
+         b.reserve(64, 11);
+         mat::add(a, b, out);
+         assert_equal(out.at(20, 5), (10.0f + 5) * 2 - 6 + 15);
+
+         Matrix<float> wrong(2, 3);
+         try {
+            mat::add(a, wrong, out);
+
+         } catch (const ValueException& e) {
+            cerr << "Received expected ValueException: " << e.get_message() << endl;
+            return true;
+         }
+
+         return false;
+      })
+      .test("Reductions and transpose", [&]()->bool {
+         Matrix<int> m(1001, 13, [](int x, int y) { return x - y * 100; });
+
+         long expected = 0;
+         m.scan([&](int, int, const int& val) {
+            expected += val;
+            return true;
+         });
+
+         assert_equal((long)mat::sum(m), expected);
+         assert_equal(mat::minimum(m), -1200);
+         assert_equal(mat::maximum(m), 1000);
+
+         Matrix<double> d(100, 100, [](int x, int y) { return x * 0.25 - y; });
+         assert_equal(mat::sum(d), 100 * (99 * 0.25 * 50) - 100 * (99 * 50.0));
+
+         Matrix<int> t = mat::transpose(m);
+         assert_equal(t.width(), 13);
+         assert_equal(t.height(), 1001);
+         assert_equal(t.at(12, 1000), m.at(1000, 12));
+         assert_equal(t.at(3, 77), m.at(77, 3));
+
+         return true;
+      })
+      .test("3x3 and 5x5 convolution", [&]()->bool {
+         Matrix<float> src(64, 9, [](int x, int y) { return (float)((x * 7 + y * 13) % 17); });
+         Matrix<float> out(64, 9);
+
+         const float box[9] = {1, 1, 1, 1, 1, 1, 1, 1, 1};
+         mat::convolve3x3(src, box, out);
+
+         auto clamped = [&](int x, int y) {
+            return src.at(min(max(x, 0), 63), min(max(y, 0), 8));
+         };
+
+         for (int y = 0; y < 9; y++) {
+            for (int x = 0; x < 64; x++) {
+               float expected = 0;
+               for (int ky = -1; ky <= 1; ky++) {
+                  for (int kx = -1; kx <= 1; kx++) {
+                     expected += clamped(x + kx, y + ky);
+                  }
+               }
+               assert_equal(out.at(x, y), expected);
+            }
+         }
+
+         float gauss[25];
+         for (int n = 0; n < 25; n++) {
+            gauss[n] = (n == 12) ? 1.0f : 0.0f;
+         }
+         mat::convolve5x5(src, gauss, out);
+         for (int y = 0; y < 9; y++) {
+            for (int x = 0; x < 64; x++) {
+               assert_equal(out.at(x, y), src.at(x, y));
+            }
+         }
+
+         return true;
+      })
+      .test("Dispatched kernels give bit-identical results", [&]()->bool {
+#ifdef LAIN_MATH_DISPATCH_AVX2
+         if (! mat::impl::has_avx2()) {
+            cout << "AVX2 is not supported, skipping." << endl;
+            return true;
+         }
+
+         const size_t N = 1003;
+         vector<float> a(N), b(N), c(N), generic(N), avx2(N);
+         for (size_t i = 0; i < N; i++) {
+            a[i] = 1.0f / (i + 3);
+            b[i] = (float)i / 7.0f - 50.0f;
+            c[i] = 1.0f / (i * i + 1);
+         }
+
+         const float* pa = a.data();
+         const float* pb = b.data();
+         const float* pc = c.data();
+         auto muladd = [=](size_t i) LAIN_MATH_INLINE {
+            return pa[i] * pb[i] + pc[i] * pa[i + 1] * pb[i + 1] + pc[i + 1];
+         };
+         mat::impl::generate_generic(generic.data(), N - 1, muladd);
+         mat::impl::generate_avx2(avx2.data(), N - 1, muladd);
+         assert_true(memcmp(generic.data(), avx2.data(), N * sizeof(float)) == 0);
+
+         auto add = [](float x, float y) LAIN_MATH_INLINE { return x + y; };
+         auto product = [=](size_t i) LAIN_MATH_INLINE { return pa[i] * pb[i]; };
+         float generic_acc[mat::impl::REDUCE_LANES] = {0};
+         float avx2_acc[mat::impl::REDUCE_LANES] = {0};
+         mat::impl::reduce_generic(generic_acc, N, product, add);
+         mat::impl::reduce_avx2(avx2_acc, N, product, add);
+         assert_true(memcmp(generic_acc, avx2_acc, sizeof(generic_acc)) == 0);
+#else
+         cout << "Runtime dispatch is disabled, skipping." << endl;
+#endif
+         return true;
+      })
+      .test("Bulk add compared to at() loop", [&]()->bool {
+         Matrix<float> a(4000, 1000, 1.5f), b(4000, 1000, 2.0f), out(4000, 1000);
+
+         auto start_time = steady_clock::now();
+         for (int y = 0; y < a.height(); y++) {
+            for (int x = 0; x < a.width(); x++) {
+               out.at(x, y) = a.at(x, y) + b.at(x, y);
+            }
+         }
+         int loop_millis = duration_cast<milliseconds>(
+               steady_clock::now() - start_time).count();
+
+         start_time = steady_clock::now();
+         mat::add(a, b, out);
+         int bulk_millis = duration_cast<milliseconds>(
+               steady_clock::now() - start_time).count();
+
+         cout << "at() loop " << loop_millis << "ms, mat::add "
+              << bulk_millis << "ms" << endl;
+         assert_equal(mat::sum(out), 3.5f * 4000 * 1000);
+
+         return true;
+      })
+      .run();
+}
@@ -0,0 +1,71 @@
+#include "lain/perf_counters.h"
+#include "lain/benchmark.h"
+#include "lain/testing.h"
+#include "lain/macros.h"
+
+using namespace std;
+using namespace lain;
+using namespace lain::testing;
+
+int main(int argc, char** argv) {
+   UNUSED(argc); UNUSED(argv);
+
+   return TestSuite("perf counters (perf_counters.h) tests")
+      .die_on_signal(SIGSEGV)
+      .test("Counters count work or are unavailable", [&]()->bool {
+         PerfCounters counters;
+         if (! counters.available()) {
+            cout << "Performance counters are not available here." << endl;
+            assert_true(counters.read().empty());
+            return true;
+         }
+
+         volatile long sum = 0;
+         counters.start();
+         for (int x = 0; x < 1000000; x++) {
+            sum += x;
+         }
+         counters.stop();
+
+         map<string, double> values = counters.read();
+         for (auto& kv : values) {
+            cout << kv.first << ": " << kv.second << endl;
+         }
+         if (values.find("instructions") != values.end()) {
+            assert_true(values["instructions"] > 1000000);
+         }
+         return true;
+      })
+      .test("Benchmarks degrade to timing only", [&]()->bool {
+         bench::Options opts;
+         opts.repetitions = 3;
+         opts.min_sample_ns = 1e5;
+         opts.perf_counters = true;
+
+         bench::BenchmarkResult result = bench::measure("loop", []() {
+            long sum = 0;
+            for (int x = 0; x < 1000; x++) {
+               sum += x;
+               do_not_optimize(sum);
+            }
+         }, opts);
+
+         cout << bench::format_summary(result);
+         assert_true(result.median() > 0);
+         assert_equal(result.get_counters().empty(), ! PerfCounters().available());
+         return true;
+      })
+      .test("Counters round trip through JSON", [&]()->bool {
+         bench::Options opts;
+         opts.repetitions = 2;
+         bench::BenchmarkResult result("counted", opts, {1.0, 2.0});
+         result.set_counters({{"cycles", 1200.0}, {"instructions", 2400.0}});
+
+         bench::BenchmarkResult loaded = bench::BenchmarkResult::from_settings(result.to_settings());
+         assert_equal(loaded.get_counters().size(), (size_t)2);
+         assert_equal(loaded.get_counters().at("instructions"), 2400.0);
+         assert_true(bench::format_summary(loaded).find("IPC 2") != string::npos);
+         return true;
+      })
+      .run();
+}
@@ -4,35 +4,180 @@
 # run-tests.py: A basic test harness for executable tests.
 #
 # Runs all tests in the current directory, prints and returns the total
-# number of tests which failed.
+# number of tests which failed.  Test modules are run concurrently, and
+# each module's output is printed in full once it has finished.
+#
+# Use --shard i/n to run only the i-th (0 <= i < n) of n deterministic
+# slices of the test modules, and --json or --junit to write a report
+# with the wall time of each module.
 #
 # Author: Lain Supe (lainproliant)
 # Date: Fri October 10 2014
 #
 
+import argparse
 import glob
+import json
+import multiprocessing
+import os
 import subprocess
 import sys
+import threading
+import time
+import zlib
+import xml.etree.ElementTree as ET
 
 EXCLUDE = {'./ansi.test'}
 
+class ModuleResult(object):
+    def __init__(self, name, returncode, output, elapsed):
+        self.name = name
+        self.returncode = returncode
+        self.output = output
+        self.elapsed = elapsed
+
+    @property
+    def tests_failed(self):
+        # Test binaries return the number of failed tests.  A module
+        # killed by a signal counts as a single failure.
+        if self.returncode < 0:
+            return 1
+        return self.returncode
+
+    @property
+    def crashed(self):
+        return self.returncode < 0
+
+def module_name(test):
+    return os.path.splitext(os.path.basename(test))[0]
+
+def parse_shard(shard):
+    try:
+        index, count = [int(x) for x in shard.split('/')]
+    except ValueError:
+        raise argparse.ArgumentTypeError("Shard must be of the form i/n.")
+    if count < 1 or not 0 <= index < count:
+        raise argparse.ArgumentTypeError("Shard index must satisfy 0 <= i < n.")
+    return index, count
+
+def in_shard(test, shard):
+    # Hash the module name so that adding or removing a module doesn't
+    # move the others between shards.
+    index, count = shard
+    return zlib.crc32(module_name(test).encode('utf-8')) % count == index
+
+def run_module(test):
+    start = time.time()
+    proc = subprocess.Popen(test, stdout=subprocess.PIPE, stderr=subprocess.STDOUT)
+    output, _ = proc.communicate()
+    return ModuleResult(module_name(test), proc.returncode,
+                        output.decode('utf-8', 'replace'), time.time() - start)
+
+def run_all(tests, jobs):
+    pending = list(reversed(tests))
+    results = []
+    lock = threading.Lock()
+
+    def worker():
+        while True:
+            with lock:
+                if not pending:
+                    return
+                test = pending.pop()
+            result = run_module(test)
+            with lock:
+                sys.stdout.write(result.output)
+                print("----- %s: %s (%.3fs) -----" % (
+                    result.name,
+                    "CRASHED" if result.crashed else
+                    "%d FAILED" % result.tests_failed if result.tests_failed else
+                    "PASSED",
+                    result.elapsed))
+                sys.stdout.flush()
+                results.append(result)
+
+    threads = [threading.Thread(target=worker) for x in range(min(jobs, len(tests)))]
+    for thread in threads:
+        thread.start()
+    for thread in threads:
+        thread.join()
+
+    return sorted(results, key=lambda r: r.name)
+
+def write_json(filename, results, elapsed):
+    report = {
+        'elapsed': elapsed,
+        'tests_failed': sum(r.tests_failed for r in results),
+        'modules': [{
+            'name': r.name,
+            'elapsed': r.elapsed,
+            'returncode': r.returncode,
+            'tests_failed': r.tests_failed
+        } for r in results]
+    }
+    with open(filename, 'w') as outfile:
+        json.dump(report, outfile, indent=2, sort_keys=True)
+
+def write_junit(filename, results, elapsed):
+    suites = ET.Element('testsuites')
+    suite = ET.SubElement(suites, 'testsuite', {
+        'name': 'lain',
+        'tests': str(len(results)),
+        'failures': str(sum(1 for r in results if r.returncode > 0)),
+        'errors': str(sum(1 for r in results if r.crashed)),
+        'time': '%.3f' % elapsed
+    })
+    for result in results:
+        case = ET.SubElement(suite, 'testcase', {
+            'classname': 'lain',
+            'name': result.name,
+            'time': '%.3f' % result.elapsed
+        })
+        if result.crashed:
+            ET.SubElement(case, 'error', {
+                'message': 'Killed by signal %d.' % -result.returncode})
+        elif result.tests_failed > 0:
+            ET.SubElement(case, 'failure', {
+                'message': '%d tests failed.' % result.tests_failed})
+        ET.SubElement(case, 'system-out').text = result.output
+    ET.ElementTree(suites).write(filename, encoding='utf-8', xml_declaration=True)
+
 def main(argv):
-    tests_failed = 0
-    modules_failed = 0
+    parser = argparse.ArgumentParser(description='Run executable tests.')
+    parser.add_argument('-j', '--jobs', type=int, default=multiprocessing.cpu_count(),
+                        help='The number of test modules to run at once.')
+    parser.add_argument('--shard', type=parse_shard, default=(0, 1),
+                        help='Run only shard i of n, where 0 <= i < n.')
+    parser.add_argument('--json', help='Write a JSON timing report to this file.')
+    parser.add_argument('--junit', help='Write a JUnit XML report to this file.')
+    args = parser.parse_args(argv)
 
-    tests = glob.glob("./*.test")
-    for test in [t for t in tests if not t in EXCLUDE]:
-        num_failed = subprocess.call(test)
-        if num_failed > 0:
-            modules_failed += 1
-            tests_failed += num_failed
+    tests = sorted(t for t in glob.glob("./*.test")
+                   if not t in EXCLUDE and in_shard(t, args.shard))
+
+    start = time.time()
+    results = run_all(tests, max(1, args.jobs))
+    elapsed = time.time() - start
+
+    tests_failed = sum(r.tests_failed for r in results)
+    modules_failed = sum(1 for r in results if r.tests_failed > 0)
+
+    print("===== TIMING =====")
+    for result in sorted(results, key=lambda r: r.elapsed, reverse=True):
+        print("    %8.3fs  %s" % (result.elapsed, result.name))
+    print("    %8.3fs  (wall time, %d jobs)" % (elapsed, args.jobs))
 
     print("===== SUMMARY =====")
-    print("    %d modules PASSED." % (len(tests) - modules_failed))
+    print("    %d modules PASSED." % (len(results) - modules_failed))
     if modules_failed > 0:
         print("    %d modules FAILED, %d overall tests FAILED." % (
             modules_failed, tests_failed));
 
+    if args.json:
+        write_json(args.json, results, elapsed)
+    if args.junit:
+        write_junit(args.junit, results, elapsed)
+
     sys.exit(tests_failed)
 
 if __name__ == "__main__":
@@ -1,3 +1,6 @@
+#define LAIN_TESTING_BENCHMARKS
+#define LAIN_INSTALL_ALLOC_HOOK
+#include "lain/alloc_hook.h"
 #include "lain/settings.h"
 #include "lain/testing.h"
 
@@ -103,5 +106,211 @@ int main() {
          cout << settings.to_string() << endl;
          return true;
       })
+      .test("Settings-008: Non-throwing lookups with try_get", [&]()->bool {
+         Settings settings = Settings::load_from_file("json/test001.json");
+         Settings graphics_settings = settings.get_object("graphics", true);
+
+         int width = 0;
+         assert_true(graphics_settings.try_get<int>("width", width));
+         assert_equal(width, 1920);
+
+         int depth = 32;
+         assert_false(graphics_settings.try_get<int>("depth", depth));
+         assert_equal(depth, 32);
+
+         string name = "unchanged";
+         assert_false(graphics_settings.try_get<string>("width", name));
+         assert_equal(name, string("unchanged"));
+
+         vector<int> numbers;
+         Settings arrays = Settings::load_from_file("json/test004.json");
+         assert_true(arrays.try_get_array<int>("numbers", numbers));
+         assert_true(lists_equal(numbers, {1, 2, 3, 4, 5}));
+         assert_false(arrays.try_get_array<int>("strings", numbers));
+         assert_false(arrays.try_get_array<int>("missing", numbers));
+         assert_true(lists_equal(numbers, {1, 2, 3, 4, 5}));
+
+         Settings mixed = Settings::load_from_file("json/test006.json");
+         assert_false(mixed.try_get_array<int>("numbers", numbers));
+         return true;
+      })
+      .test("Settings-009: Missing keys with defaults don't allocate", [&]()->bool {
+         Settings settings = Settings::load_from_file("json/test001.json");
+         Settings graphics_settings = settings.get_object("graphics", true);
+         const string key = "fullscreen_override";
+         int value = 0;
+
+         assert_no_allocations([&]() {
+            value = graphics_settings.get_default<int>(key, 7);
+            do_not_optimize(value);
+            do_not_optimize(graphics_settings.try_get<int>(key, value));
+         });
+         assert_equal(value, 7);
+         return true;
+      })
+      .test("Settings-010: Loading only selected top-level keys", [&]()->bool {
+         Settings settings = Settings::load_from_string(
+            "{\"audio\": {\"volume\": 11, \"tracks\": [\"a\", \"b\"]},"
+            " \"graphics\": {\"width\": 1920}, \"name\": \"lain\"}",
+            {"graphics", "name"});
+
+         assert_true(lists_equal(settings.get_keys(), {"graphics", "name"}));
+         assert_equal(settings.get_object("graphics").get<int>("width"), 1920);
+         assert_equal(settings.get<string>("name"), string("lain"));
+
+         settings = Settings::load_from_file("json/test001.json", {"sound"});
+         assert_true(settings.get_keys().empty());
+         return true;
+      })
+      .test("Settings-011: Invalid and non-object documents throw SettingsException", [&]()->bool {
+         for (const char* json : {"{\"a\": }", "[1, 2, 3]", "42", ""}) {
+            try {
+               Settings::load_from_string(json);
+
+            } catch (const SettingsException& e) {
+               cerr << "Received expected SettingsException: "
+                    << e.get_message()
+                    << endl;
+               continue;
+            }
+
+            return false;
+         }
+
+         return true;
+      })
+      .test("Settings-012: Child objects are views which copy on write", [&]()->bool {
+         Settings settings = Settings::load_from_string(
+            "{\"a\": {\"b\": {\"c\": 1}}, \"list\": [{\"x\": 1}, {\"x\": 2}]}");
+         Settings b = settings.get_object("a").get_object("b");
+         vector<Settings> list = settings.get_object_array("list");
+
+         b.set<int>("c", 2);
+         list[0].set<int>("x", 3);
+         assert_equal(b.get<int>("c"), 2);
+         assert_equal(list[0].get<int>("x"), 3);
+         assert_equal(settings.get_object("a").get_object("b").get<int>("c"), 1);
+         assert_equal(settings.get_object_array("list")[0].get<int>("x"), 1);
+
+         // Views may be stored back over the values they refer to.
+         settings.set_object_array("list", settings.get_object_array("list"));
+         assert_equal(settings.get_object_array("list")[1].get<int>("x"), 2);
+         settings.set_object("self", settings.get_object_array("list")[1]);
+         assert_equal(settings.get_object("self").get<int>("x"), 2);
+         return true;
+      })
+      .test("Settings-013: Nested object walks don't copy", [&]()->bool {
+         Settings settings = Settings::load_from_string(
+            "{\"a\": {\"b\": {\"c\": {\"d\": 42}}}}");
+         const string a = "a", b = "b", c = "c", d = "d";
+         int value = 0;
+
+         assert_no_allocations([&]() {
+            value = settings.get_object(a).get_object(b).get_object(c).get<int>(d);
+         });
+         assert_equal(value, 42);
+         return true;
+      })
+      .test("Settings-014: Dotted paths and JSON Pointers", [&]()->bool {
+         Settings settings = Settings::load_from_string(
+            "{\"a\": {\"b\": [{\"c\": 1}, {\"c\": 2, \"d.e\": \"dot\"}]},"
+            " \"a/b\": 3, \"m~n\": 4, \"7\": {\"x\": true}}");
+
+         assert_equal(settings.get<int>(SettingsPath("a.b[1].c")), 2);
+         assert_equal(settings.get<string>(SettingsPath("a.b[1].d\\.e")), string("dot"));
+         assert_equal(settings.at_path("a.b[0]").get<int>("c"), 1);
+         assert_equal(settings.get<int>(SettingsPath::pointer("/a/b/1/c")), 2);
+         assert_equal(settings.get<int>(SettingsPath::pointer("/a~1b")), 3);
+         assert_equal(settings.get<int>(SettingsPath::pointer("/m~0n")), 4);
+         assert_true(settings.get<bool>(SettingsPath::pointer("/7/x")));
+         assert_equal(settings.at_pointer("").get_keys().size(), (size_t)4);
+
+         assert_false(settings.contains(SettingsPath("a.b[2]")));
+         assert_false(settings.contains(SettingsPath("a[0]")));
+         assert_false(settings.contains(SettingsPath::pointer("/a/b/01")));
+         assert_equal(settings.get_default<int>(SettingsPath("a.b[0].missing"), 5), 5);
+
+         int value = 0;
+         assert_false(settings.try_get<int>(SettingsPath("a.b[1].d\\.e"), value));
+         assert_equal(value, 0);
+
+         for (const char* path : {"a..b", "a.", "a[x]", "a[1]b", "a\\"}) {
+            try {
+               SettingsPath invalid(path);
+
+            } catch (const SettingsException& e) {
+               cerr << "Received expected SettingsException: " << e.get_message() << endl;
+               continue;
+            }
+
+            return false;
+         }
+
+         try {
+            settings.at_path("a.b[1].c");
+
+         } catch (const SettingsException& e) {
+            cerr << "Received expected SettingsException: " << e.get_message() << endl;
+            return true;
+         }
+
+         return false;
+      })
+      .test("Settings-015: Precompiled paths are reusable and don't allocate", [&]()->bool {
+         const SettingsPath path("server.limits[1].rate");
+         Settings first = Settings::load_from_string(
+            "{\"server\": {\"limits\": [{\"rate\": 1}, {\"rate\": 10}]}}");
+         Settings second = Settings::load_from_string(
+            "{\"server\": {\"limits\": [{\"rate\": 2}, {\"rate\": 20}]}}");
+         int total = 0;
+
+         assert_no_allocations([&]() {
+            total = first.get<int>(path) + second.get<int>(path);
+         });
+         assert_equal(total, 30);
+         return true;
+      })
+      .test("Settings-016: Copies share writes and views don't", [&]()->bool {
+         Settings settings = Settings::load_from_string("{\"a\": {\"b\": 1}}");
+
+         Settings copy = settings;
+         settings.set<int>("x", 1);
+         copy.set<int>("y", 2);
+         assert_equal(copy.get<int>("d", 3), 3);
+         assert_true(settings.contains("x") && settings.contains("y") && settings.contains("d"));
+         assert_true(copy.contains("x"));
+
+         shared_ptr<pj::value> json = make_shared<pj::value>(pj::object());
+         Settings wrapped(json);
+         wrapped.set<int>("z", 3);
+         assert_true(json->contains("z"));
+
+         // A modified view is stored back explicitly, after which
+         // copies of it share writes again.
+         Settings a = settings.get_object("a");
+         assert_equal(a.get<int>("c", 4), 4);
+         a.set<int>("b", 5);
+         assert_false(settings.get_object("a").contains("c"));
+         assert_equal(settings.get_object("a").get<int>("b"), 1);
+         settings.set_object("a", a);
+         assert_equal(settings.get_object("a").get<int>("b"), 5);
+
+         Settings a_copy = a;
+         a_copy.set<int>("b", 6);
+         assert_equal(a.get<int>("b"), 6);
+         return true;
+      })
+      .benchmark("Settings-017: get on a precompiled path", [&]() {
+         static const SettingsPath path("a.b.c.d");
+         static Settings settings = Settings::load_from_string(
+            "{\"a\": {\"b\": {\"c\": {\"d\": 42}}}}");
+         do_not_optimize(settings.get<int>(path));
+      })
+      .benchmark("Settings-018: get_default on a missing key", [&]() {
+         static Settings settings = Settings::load_from_file("json/test001.json")
+            .get_object("graphics", true);
+         static const string key = "missing";
+         do_not_optimize(settings.get_default<int>(key, 0));
+      })
       .run();
 }
@@ -0,0 +1,155 @@
+#define LAIN_TESTING_BENCHMARKS
+#include "lain/settings_schema.h"
+#include "lain/testing.h"
+
+using namespace std;
+using namespace lain;
+using namespace lain::testing;
+
+namespace config {
+   struct Limit {
+      string name;
+      double rate;
+   };
+
+   inline auto settings_schema(const Limit*) {
+      return schema::fields(
+         LAIN_FIELD(Limit, name),
+         LAIN_FIELD(Limit, rate));
+   }
+
+   struct Server {
+      string host;
+      int port;
+      bool verbose = false;
+      float timeout = 2.5;
+      vector<int> ports;
+      vector<bool> enabled;
+      vector<Limit> limits;
+   };
+
+   inline auto settings_schema(const Server*) {
+      return schema::fields(
+         LAIN_FIELD(Server, host),
+         LAIN_FIELD(Server, port),
+         LAIN_OPTIONAL_FIELD(Server, verbose),
+         LAIN_OPTIONAL_FIELD(Server, timeout),
+         LAIN_OPTIONAL_FIELD(Server, ports),
+         LAIN_OPTIONAL_FIELD(Server, enabled),
+         schema::field("rate_limits", &Server::limits));
+   }
+
+   struct Config {
+      Server server;
+      vector<string> tags;
+   };
+
+   inline auto settings_schema(const Config*) {
+      return schema::fields(
+         LAIN_FIELD(Config, server),
+         LAIN_OPTIONAL_FIELD(Config, tags));
+   }
+}
+
+using namespace config;
+
+const char* CONFIG_JSON =
+   "{\"server\": {\"host\": \"localhost\", \"port\": 8080, \"ports\": [1, 2], \"enabled\": [true, false],"
+   " \"rate_limits\": [{\"name\": \"read\", \"rate\": 10.5}, {\"name\": \"write\", \"rate\": 2}]},"
+   " \"tags\": [\"a\", \"b\"], \"unknown\": 1}";
+
+int main() {
+   return TestSuite("settings_schema (settings_schema.h) tests")
+      .die_on_signal(SIGSEGV)
+      .test("SettingsSchema-001: Reading a nested struct", [&]()->bool {
+         Config config = schema::from_settings<Config>(Settings::load_from_string(CONFIG_JSON));
+
+         assert_equal(config.server.host, string("localhost"));
+         assert_equal(config.server.port, 8080);
+         assert_false(config.server.verbose);
+         assert_equal(config.server.timeout, 2.5f);
+         assert_true(lists_equal(config.server.ports, {1, 2}));
+         assert_true(lists_equal(config.server.enabled, {true, false}));
+         assert_equal(config.server.limits.size(), (size_t)2);
+         assert_equal(config.server.limits[0].name, string("read"));
+         assert_equal(config.server.limits[0].rate, 10.5);
+         assert_equal(config.server.limits[1].rate, 2.0);
+         assert_true(lists_equal(config.tags, {"a", "b"}));
+         return true;
+      })
+      .test("SettingsSchema-002: Round trip through Settings", [&]()->bool {
+         Config config = schema::from_settings<Config>(Settings::load_from_string(CONFIG_JSON));
+         config.server.verbose = true;
+         config.server.enabled.push_back(true);
+         config.server.limits.push_back({"admin", 0.5});
+
+         Settings settings = schema::to_settings(config);
+         assert_true(settings.get<bool>(SettingsPath("server.verbose")));
+         assert_equal(settings.get<string>(SettingsPath("server.rate_limits[2].name")), string("admin"));
+         assert_false(settings.contains("unknown"));
+
+         Config copy = schema::from_settings<Config>(Settings::load_from_string(settings.to_string()));
+         assert_true(copy.server.verbose);
+         assert_true(lists_equal(copy.server.enabled, {true, false, true}));
+         assert_equal(copy.server.limits.size(), (size_t)3);
+         assert_equal(copy.server.limits[2].rate, 0.5);
+         assert_equal(settings.to_string(), schema::to_settings(copy).to_string());
+         return true;
+      })
+      .test("SettingsSchema-003: Every error is reported at once", [&]()->bool {
+         Settings settings = Settings::load_from_string(
+            "{\"server\": {\"port\": 80.5, \"verbose\": \"yes\", \"ports\": [1, \"2\", 1e20, -3e9],"
+            " \"enabled\": [true, 0],"
+            " \"rate_limits\": [{\"name\": \"read\"}, 7]}, \"tags\": {}}");
+
+         Config config;
+         vector<string> errors;
+         assert_false(schema::read(settings, config, errors));
+         for (const string& error : errors) {
+            cout << error << endl;
+         }
+
+         assert_true(lists_equal(errors, {
+            "server.host: Missing required value.",
+            "server.port: Expected an integer.",
+            "server.verbose: Expected a boolean.",
+            "server.ports[1]: Expected an integer.",
+            "server.ports[2]: Expected an integer.",
+            "server.ports[3]: Expected an integer.",
+            "server.enabled[1]: Expected a boolean.",
+            "server.rate_limits[0].rate: Missing required value.",
+            "server.rate_limits[1]: Expected an object.",
+            "tags: Expected an array."}));
+
+         try {
+            schema::from_settings<Config>(settings);
+
+         } catch (const SchemaException& e) {
+            cerr << "Received expected SchemaException: " << e.get_message() << endl;
+            assert_equal(e.get_errors().size(), (size_t)10);
+            return true;
+         }
+
+         return false;
+      })
+      .test("SettingsSchema-004: Reading from a child view", [&]()->bool {
+         Settings settings = Settings::load_from_string(CONFIG_JSON);
+         Server server = schema::from_settings<Server>(settings.get_object("server"));
+         assert_equal(server.port, 8080);
+
+         vector<string> errors;
+         Limit limit;
+         assert_true(schema::read(settings.at_path("server.rate_limits[1]"), limit, errors));
+         assert_equal(limit.name, string("write"));
+         assert_true(errors.empty());
+         return true;
+      })
+      .benchmark("SettingsSchema-005: Reading a nested struct", [&]() {
+         static Settings settings = Settings::load_from_string(CONFIG_JSON);
+         Config config;
+         vector<string> errors;
+         do_not_optimize(schema::read(settings, config, errors));
+         do_not_optimize(config);
+      })
+      .run();
+}
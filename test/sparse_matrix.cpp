@@ -0,0 +1,52 @@
+#include "lain/sparse_matrix.h"
+#include "lain/testing.h"
+#include "lain/macros.h"
+
+using namespace std;
+using namespace lain;
+using namespace lain::testing;
+
+int main(int argc, char** argv) {
+   UNUSED(argc); UNUSED(argv);
+
+   return TestSuite("sparse matrix (sparse_matrix.h) tests")
+      .die_on_signal(SIGSEGV)
+      .test("SparseMatrix allocates chunks lazily", [&]()->bool {
+         SparseMatrix<int, 16, 16> m(1000, 500, -1);
+         const SparseMatrix<int, 16, 16>& cm = m;
+
+         assert_equal(cm.at(999, 499), -1);
+         m.set(10, 10, -1);
+         assert_equal(m.populated_chunks(), (size_t)0);
+
+         m.set(10, 10, 5);
+         m.at(999, 499) = 7;
+         assert_equal(m.populated_chunks(), (size_t)2);
+         assert_equal(m.get(10, 10), 5);
+         assert_equal(m.get(11, 10), -1);
+         assert_true(m.memory_usage() < m.dense_memory_usage() / 10);
+
+         int visited = 0, sum = 0;
+         cm.scan([&](int, int, const int& val) {
+            visited++;
+            sum += val;
+            return true;
+         });
+         // The chunk at (999, 499) is clipped to 8 x 4 cells.
+         assert_equal(visited, 16 * 16 + 8 * 4);
+         assert_equal(sum, 5 + 7 - (visited - 2));
+
+         SparseMatrix<int, 16, 16> copy = m;
+         m.set(10, 10, -1);
+         assert_equal(m.prune(), (size_t)1);
+         assert_equal(m.populated_chunks(), (size_t)1);
+         assert_equal(copy.get(10, 10), 5);
+
+         m.clear();
+         assert_equal(m.populated_chunks(), (size_t)0);
+         assert_equal(m.get(999, 499), -1);
+
+         return true;
+      })
+      .run();
+}
@@ -1,7 +1,14 @@
+#define LAIN_TESTING_BENCHMARKS
+#define LAIN_TESTING_POSIX
+#include <cstdio>
 #include <iostream>
+#include <map>
+#include <sstream>
+#include <thread>
 #include "lain/testing.h"
 
 using namespace std;
+using namespace lain;
 using namespace lain::testing;
 
 int main(int argc, char** argv) {
@@ -30,6 +37,240 @@ int main(int argc, char** argv) {
             })
             .run(cnull) == 1;
       })
+      .test("Benchmarks report statistics and pass", []()->bool {
+         ostringstream sout;
+         bench::Options opts;
+         opts.repetitions = 5;
+         opts.min_sample_ns = 1e5;
+         opts.elements = 100;
+         opts.bytes = 100 * sizeof(int);
+
+         int failed = TestSuite("internal test suite")
+            .benchmark("sum", []() {
+               int sum = 0;
+               for (int x = 0; x < 100; x++) {
+                  sum += x;
+                  do_not_optimize(sum);
+               }
+            }, opts)
+            .run(sout);
+
+         cout << sout.str();
+         assert_equal(failed, 0);
+         assert_true(sout.str().find("median") != string::npos);
+         assert_true(sout.str().find("GB/s") != string::npos);
+         return true;
+      })
+      .test("Forced benchmark failure by runtime exception", []()->bool {
+         ostream cnull(0);
+         return TestSuite("internal test suite")
+            .benchmark("doomed benchmark", []() {
+               throw runtime_error("oh noes!");
+            })
+            .run(cnull) == 1;
+      })
+      .test("Benchmark iterations are calibrated", []()->bool {
+         bench::Options opts;
+         opts.repetitions = 3;
+         opts.min_sample_ns = 1e6;
+
+         int counter = 0;
+         bench::BenchmarkResult result = bench::measure("increment", [&]() {
+            counter++;
+            clobber_memory();
+         }, opts);
+
+         assert_true(result.get_iterations() > 1);
+         assert_equal(result.get_samples().size(), (size_t)3);
+         assert_true(result.percentile(0) <= result.median());
+         assert_true(result.median() <= result.percentile(100));
+         return true;
+      })
+      .test("Parallel run captures output in registration order", []()->bool {
+         ostringstream sout;
+         TestSuite suite("internal parallel suite");
+         for (int x = 0; x < 16; x++) {
+            suite.test(tfm::format("test %d", x), [x]()->bool {
+               // Finish in roughly reverse order of registration.
+               this_thread::sleep_for(chrono::milliseconds(2 * (16 - x)));
+               cout << "output of test " << x << endl;
+               cerr << "error of test " << x << endl;
+               return x % 4 != 0;
+            });
+         }
+         suite.test("throwing test", []()->bool {
+            throw runtime_error("oh noes!");
+         });
+
+         int failed = suite.parallel(4).run(sout);
+         string output = sout.str();
+         cout << output;
+
+         assert_equal(failed, 5);
+         assert_true(output.find("FAILED (") != string::npos);
+
+         size_t pos = 0;
+         for (int x = 0; x < 16; x++) {
+            size_t header = output.find(tfm::format("Running test: 'test %d'", x), pos);
+            size_t line = output.find(tfm::format("output of test %d\n", x), pos);
+            size_t error = output.find(tfm::format("error of test %d\n", x), pos);
+            assert_true(header != string::npos && header < line && line < error,
+                        tfm::format("Output of test %d out of order.", x));
+            pos = error;
+         }
+         return true;
+      })
+      .test("Mann-Whitney test detects shifted samples", []()->bool {
+         vector<double> fast = {10, 11, 10, 12, 11, 10, 11, 12, 10, 11};
+         vector<double> slow = {14, 15, 14, 16, 15, 14, 15, 16, 14, 15};
+
+         assert_true(bench::mann_whitney_p(fast, slow) < 0.001);
+         assert_true(bench::mann_whitney_p(slow, fast) > 0.999);
+         assert_true(abs(bench::mann_whitney_p(fast, fast) - 0.5) < 0.1);
+         return true;
+      })
+      .test("Benchmark baselines are saved and regressions fail", []()->bool {
+         const string filename = "testing-baseline.json.output";
+         remove(filename.c_str());
+
+         bench::Options opts;
+         opts.repetitions = 10;
+         opts.iterations = 1;
+         opts.min_sample_ns = 0;
+
+         auto spin_for = [](int us) {
+            return [us]() {
+               auto end = chrono::steady_clock::now() + chrono::microseconds(us);
+               while (chrono::steady_clock::now() < end) {
+                  clobber_memory();
+               }
+            };
+         };
+
+         ostringstream sout;
+         int failed = TestSuite("baseline suite")
+            .baseline(filename)
+            .benchmark("spin", spin_for(200), opts)
+            .run(sout);
+         assert_equal(failed, 0);
+         assert_true(sout.str().find("Saved benchmark baseline") != string::npos);
+
+         map<string, bench::BenchmarkResult> saved = bench::load_results(filename);
+         assert_equal(saved.size(), (size_t)1);
+         assert_equal(saved["spin"].get_samples().size(), (size_t)10);
+
+         failed = TestSuite("baseline suite")
+            .baseline(filename)
+            .benchmark("spin", spin_for(200), opts)
+            .run(sout);
+         cout << sout.str();
+         assert_equal(failed, 0);
+
+         ostringstream regress_out;
+         failed = TestSuite("baseline suite")
+            .baseline(filename)
+            .benchmark("spin", spin_for(400), opts)
+            .run(regress_out);
+         cout << regress_out.str();
+         assert_equal(failed, 1);
+         assert_true(regress_out.str().find("REGRESSION") != string::npos);
+         return true;
+      })
+      .test("Tests report resource usage", []()->bool {
+         ostringstream sout;
+         int failed = TestSuite("internal test suite")
+            .test("allocating test", []()->bool {
+               vector<int> vec(1000);
+               return vec.size() == 1000;
+            })
+            .run(sout);
+
+         cout << sout.str();
+         assert_equal(failed, 0);
+         assert_true(sout.str().find("wall") != string::npos);
+         assert_true(sout.str().find("peak rss") != string::npos);
+         return true;
+      })
+      .test("Timeouts kill hung tests in forked children", []()->bool {
+         ostringstream sout;
+         auto start = chrono::steady_clock::now();
+         int failed = TestSuite("internal timeout suite")
+            .timeout(chrono::milliseconds(200))
+            .die_on_signal(SIGSEGV)
+            .test("hung test", []()->bool {
+               cout << "about to hang" << endl;
+               for (;;) {
+                  this_thread::sleep_for(chrono::seconds(1));
+               }
+            })
+            .test("passing test", []()->bool {
+               cout << "output from the child" << endl;
+               return true;
+            })
+            .test("failing test", []()->bool {
+               return false;
+            })
+            .test("throwing test", []()->bool {
+               throw runtime_error("oh noes!");
+            })
+            .test("crashing test", []()->bool {
+               raise(SIGSEGV);
+               return true;
+            })
+            .test("slow test with its own timeout", []()->bool {
+               this_thread::sleep_for(chrono::milliseconds(400));
+               return true;
+            }, chrono::milliseconds(2000))
+            .run(sout);
+         auto elapsed = chrono::steady_clock::now() - start;
+
+         string output = sout.str();
+         cout << output;
+         assert_equal(failed, 4);
+         assert_true(elapsed < chrono::seconds(2), "Timeout was not enforced.");
+         assert_true(output.find("about to hang") != string::npos);
+         assert_true(output.find("FAILED (timeout)") != string::npos);
+         assert_true(output.find("output from the child") != string::npos);
+         assert_true(output.find("oh noes!") != string::npos);
+         assert_true(output.find("FAILED (signal)") != string::npos);
+         return true;
+      })
+      .test("Parallel forked tests don't hold each other's output open", []()->bool {
+         TestSuite suite("internal parallel timeout suite");
+         suite.parallel(8).timeout(chrono::milliseconds(250));
+
+         for (int x = 0; x < 200; x++) {
+            if (x % 20 == 0) {
+               suite.test(tfm::format("slow test %d", x), []()->bool {
+                  this_thread::sleep_for(chrono::milliseconds(600));
+                  return true;
+               }, chrono::milliseconds(5000));
+
+            } else {
+               suite.test(tfm::format("fast test %d", x), []()->bool {
+                  return true;
+               });
+            }
+         }
+
+         ostringstream sout;
+         int failed = suite.run(sout);
+         if (failed != 0) {
+            cout << sout.str();
+         }
+         assert_equal(failed, 0);
+         return true;
+      })
+      .test("Allocation assertions require the allocation hook", []()->bool {
+         try {
+            assert_no_allocations([]() { });
+         } catch (const AssertionFailed& e) {
+            return false;
+         } catch (const TestException& e) {
+            return true;
+         }
+         return false;
+      })
       .run();
 
 }
@@ -0,0 +1,59 @@
+#include "lain/thread_pool.h"
+#include "lain/testing.h"
+#include "lain/macros.h"
+
+using namespace std;
+using namespace lain;
+using namespace lain::testing;
+
+int main(int argc, char** argv) {
+   UNUSED(argc); UNUSED(argv);
+
+   return TestSuite("thread pool (thread_pool.h) tests")
+      .die_on_signal(SIGSEGV)
+      .test("ThreadPool parallel_for visits every index once", [&]()->bool {
+         ThreadPool pool(4);
+         vector<atomic<int>> visits(1000);
+
+         pool.parallel_for(visits.size(), [&](int i) {
+            visits[i]++;
+         });
+
+         for (auto& v : visits) {
+            assert_equal(v.load(), 1);
+         }
+
+         return true;
+      })
+      .test("ThreadPool nested parallel_for", [&]()->bool {
+         ThreadPool pool(2);
+         atomic<int> total(0);
+
+         pool.parallel_for(8, [&](int i) {
+            pool.parallel_for(8, [&](int j) {
+               total += i * j;
+            });
+         });
+
+         assert_equal(total.load(), 28 * 28);
+         return true;
+      })
+      .test("ThreadPool propagates exceptions", [&]()->bool {
+         ThreadPool pool(3);
+
+         try {
+            pool.parallel_for(16, [&](int i) {
+               if (i == 7) {
+                  throw ValueException("seven");
+               }
+            });
+
+         } catch (const ValueException& e) {
+            assert_equal(e.get_message(), string("seven"));
+            return true;
+         }
+
+         return false;
+      })
+      .run();
+}